@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "concurrency/LockStats.hpp"
+#include "concurrency/SpinWait.hpp"
+
+
+// Spins for a bounded amount of time and then sleeps on the lock word
+// (a futex on Linux), so waiters don't steal CPU time from the holder
+// when there are more threads than cores. Not fair.
+class AdaptiveMutex
+{
+public:
+    // Roughly a couple of microseconds worth of pauses
+    static constexpr std::size_t SPIN_LIMIT = 64;
+
+    AdaptiveMutex() = default;
+    AdaptiveMutex(const AdaptiveMutex&) = delete;
+    AdaptiveMutex& operator=(const AdaptiveMutex&) = delete;
+
+    void lock()
+    {
+        if (!try_lock())
+        {
+            lock_slow();
+        }
+    }
+
+    bool try_lock()
+    {
+        std::uint32_t expected = UNLOCKED;
+        return state_.compare_exchange_strong(expected, LOCKED,
+            std::memory_order::acquire, std::memory_order::relaxed);
+    }
+
+    void unlock()
+    {
+        if (state_.exchange(UNLOCKED, std::memory_order::release) == CONTENDED)
+        {
+            state_.notify_one();
+        }
+    }
+
+    LockStats stats() const { return counters_.snapshot(); }
+
+private:
+    void lock_slow()
+    {
+        counters_.contended();
+
+        for (std::size_t i = 0; i < SPIN_LIMIT; ++i)
+        {
+            cpu_pause();
+            // Only try when it looks free, so that we don't steal the cacheline from the holder
+            if (state_.load(std::memory_order::relaxed) == UNLOCKED && try_lock())
+            {
+                return;
+            }
+        }
+
+        // From now on unlock has to wake someone up, even if that means a spurious wakeup
+        if (state_.exchange(CONTENDED, std::memory_order::acquire) == UNLOCKED)
+        {
+            return;
+        }
+
+        counters_.parked();
+        do
+        {
+            state_.wait(CONTENDED, std::memory_order::relaxed);
+        }
+        while (state_.exchange(CONTENDED, std::memory_order::acquire) != UNLOCKED);
+    }
+
+private:
+    static constexpr std::uint32_t UNLOCKED = 0;
+    static constexpr std::uint32_t LOCKED = 1;
+    static constexpr std::uint32_t CONTENDED = 2;
+
+    std::atomic<std::uint32_t> state_{UNLOCKED};
+    LockCounters counters_;
+};
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <mutex>
+#include <type_traits>
+
+#include "unifex/receiver_concepts.hpp"
+
+#include "concurrency/AdaptiveMutex.hpp"
+#include "concurrency/OpParkingLot.hpp"
+#include "util/Assert.hpp"
+
+
+// Reader-writer lock for coroutines and senders.
+// Waiters form a single FIFO queue, so a waiting writer stops newer readers
+// from getting in, and on release either the writer at the front or the whole
+// run of readers at the front is let in.
+// Waiters get resumed inline on the thread that released the lock.
+class AsyncRwLock
+{
+    using WaiterLot = OpParkingLot<>;
+    using OpBase = WaiterLot::OpBase;
+
+    struct Waiter : OpBase
+    {
+        template<class Derived>
+        Waiter(Derived* derived, bool excl)
+            : OpBase(derived)
+            , exclusive{excl}
+        {
+        }
+
+        bool exclusive;
+    };
+
+    template<class Receiver>
+    struct Op : Waiter
+    {
+        Op(AsyncRwLock& l, bool excl, auto&& rec)
+            : Waiter(this, excl)
+            , lock{l}
+            , receiver{std::forward<decltype(rec)>(rec)}
+        {
+        }
+
+        void start() noexcept
+        {
+            lock.do_lock(this);
+        }
+
+        void wake()
+        {
+            unifex::set_value(std::move(receiver));
+        }
+
+        AsyncRwLock& lock;
+        Receiver receiver;
+    };
+
+public:
+    struct Sender
+    {
+        template <
+            template <typename...> class Variant,
+            template <typename...> class Tuple>
+        using value_types = Variant<Tuple<>>;
+
+        template <template <typename...> class Variant>
+        using error_types = Variant<>;
+
+        static constexpr bool sends_done = false;
+
+        template<unifex::receiver_of<> Receiver>
+        auto connect(Receiver&& r)
+        {
+            return Op<std::remove_cvref_t<Receiver>>{*lock, exclusive, std::forward<Receiver>(r)};
+        }
+
+        AsyncRwLock* lock;
+        bool exclusive;
+    };
+
+    AsyncRwLock() = default;
+    AsyncRwLock(const AsyncRwLock&) = delete;
+    AsyncRwLock& operator=(const AsyncRwLock&) = delete;
+
+    // Completes once we are the only owner, call unlock afterwards
+    Sender async_lock()
+    {
+        return Sender{this, true};
+    }
+
+    // Completes once we share ownership with other readers only, call unlock_shared afterwards
+    Sender async_lock_shared()
+    {
+        return Sender{this, false};
+    }
+
+    bool try_lock()
+    {
+        std::lock_guard lock{mutex_};
+        if (writer_ || readers_ > 0 || !waiters_.empty())
+        {
+            return false;
+        }
+        writer_ = true;
+        return true;
+    }
+
+    bool try_lock_shared()
+    {
+        std::lock_guard lock{mutex_};
+        // Don't overtake the waiters, a writer might be among them
+        if (writer_ || !waiters_.empty())
+        {
+            return false;
+        }
+        ++readers_;
+        return true;
+    }
+
+    void unlock()
+    {
+        std::unique_lock lock{mutex_};
+        NG_ASSERT(writer_);
+        writer_ = false;
+        wake_next(lock);
+    }
+
+    void unlock_shared()
+    {
+        std::unique_lock lock{mutex_};
+        NG_ASSERT(readers_ > 0);
+        if (--readers_ == 0)
+        {
+            wake_next(lock);
+        }
+    }
+
+    ~AsyncRwLock() noexcept
+    {
+        NG_ASSERTF(waiters_.empty(), "Lock destroyed while someone is waiting on it!");
+    }
+
+private:
+    void do_lock(Waiter* op)
+    {
+        std::unique_lock lock{mutex_};
+        if (waiters_.empty() && admit(op))
+        {
+            lock.unlock();
+            op->wake();
+            return;
+        }
+
+        waiters_.park(op);
+    }
+
+    // Takes ownership on behalf of the op if it can get in right now
+    bool admit(Waiter* op)
+    {
+        if (writer_)
+        {
+            return false;
+        }
+
+        if (op->exclusive)
+        {
+            if (readers_ > 0)
+            {
+                return false;
+            }
+            writer_ = true;
+            return true;
+        }
+
+        ++readers_;
+        return true;
+    }
+
+    void wake_next(std::unique_lock<AdaptiveMutex>& lock)
+    {
+        waiters_.wake_while(lock,
+            [this](OpBase* op) { return admit(static_cast<Waiter*>(op)); });
+    }
+
+private:
+    AdaptiveMutex mutex_;
+    std::size_t readers_{0};
+    bool writer_{false};
+    WaiterLot waiters_;
+};
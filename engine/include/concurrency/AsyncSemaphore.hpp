@@ -0,0 +1,239 @@
+#pragma once
+
+#include <algorithm>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+
+#include "unifex/get_stop_token.hpp"
+#include "unifex/receiver_concepts.hpp"
+#include "unifex/stop_token_concepts.hpp"
+
+#include "concurrency/AdaptiveMutex.hpp"
+#include "concurrency/OpParkingLot.hpp"
+#include "util/Assert.hpp"
+
+
+// Counting semaphore for coroutines and senders. Acquiring suspends until a
+// permit is available, waiters get permits in FIFO order.
+// A waiter gets resumed inline on the thread that released its permit.
+// Waiters whose stop token gets triggered leave the queue and complete with done.
+class AsyncSemaphore
+{
+    using WaiterLot = OpParkingLot<>;
+    using OpBase = WaiterLot::OpBase;
+
+    struct WaiterBase : OpBase
+    {
+        template<class Derived>
+        explicit WaiterBase(Derived* derived)
+            : OpBase(derived)
+        {
+        }
+
+        // Both are guarded by the semaphore's mutex
+        bool parked{false};
+        // Stop came before the op got parked
+        bool stopped{false};
+    };
+
+    template<class Receiver>
+    struct Op : WaiterBase
+    {
+        using StopToken = unifex::stop_token_type_t<Receiver>;
+        static constexpr bool CANCELLABLE = !unifex::is_stop_never_possible_v<StopToken>;
+
+        struct StopCallback
+        {
+            void operator()() noexcept
+            {
+                // Might destroy the op, including this callback
+                op->semaphore.try_cancel(op);
+            }
+
+            Op* op;
+        };
+
+        struct NoStopCallback {};
+
+        using StopCallbackStorage = std::conditional_t<CANCELLABLE,
+            std::optional<typename StopToken::template callback_type<StopCallback>>, NoStopCallback>;
+
+        Op(AsyncSemaphore& s, auto&& rec)
+            : WaiterBase(this)
+            , semaphore{s}
+            , receiver{std::forward<decltype(rec)>(rec)}
+        {
+        }
+
+        void start() noexcept
+        {
+            if constexpr (CANCELLABLE)
+            {
+                auto token = unifex::get_stop_token(receiver);
+                if (token.stop_requested())
+                {
+                    unifex::set_done(std::move(receiver));
+                    return;
+                }
+
+                if (token.stop_possible())
+                {
+                    stop_callback.emplace(token, StopCallback{this});
+                }
+            }
+
+            semaphore.do_acquire(this);
+        }
+
+        // The permit is ours even if stop got requested in the meantime
+        void wake()
+        {
+            reset_stop_callback();
+            unifex::set_value(std::move(receiver));
+        }
+
+        void cancel()
+        {
+            reset_stop_callback();
+            unifex::set_done(std::move(receiver));
+        }
+
+        void reset_stop_callback()
+        {
+            if constexpr (CANCELLABLE)
+            {
+                // Waits for a concurrently running callback, which will do nothing
+                stop_callback.reset();
+            }
+        }
+
+        AsyncSemaphore& semaphore;
+        Receiver receiver;
+        [[no_unique_address]] StopCallbackStorage stop_callback;
+    };
+
+public:
+    struct Sender
+    {
+        template <
+            template <typename...> class Variant,
+            template <typename...> class Tuple>
+        using value_types = Variant<Tuple<>>;
+
+        template <template <typename...> class Variant>
+        using error_types = Variant<>;
+
+        static constexpr bool sends_done = true;
+
+        template<unifex::receiver_of<> Receiver>
+        auto connect(Receiver&& r)
+        {
+            return Op<std::remove_cvref_t<Receiver>>{*semaphore, std::forward<Receiver>(r)};
+        }
+
+        AsyncSemaphore* semaphore;
+    };
+
+    explicit AsyncSemaphore(std::size_t permits) noexcept
+        : permits_{permits}
+    {
+    }
+
+    AsyncSemaphore(const AsyncSemaphore&) = delete;
+    AsyncSemaphore& operator=(const AsyncSemaphore&) = delete;
+
+    // Completes once a permit is ours, release it afterwards.
+    // Completes with done if stop is requested while waiting, without taking a permit.
+    Sender acquire()
+    {
+        return Sender{this};
+    }
+
+    bool try_acquire()
+    {
+        std::lock_guard lock{mutex_};
+        // Don't overtake the waiters
+        if (permits_ == 0 || waiting_ != 0)
+        {
+            return false;
+        }
+        --permits_;
+        return true;
+    }
+
+    // Wakes up to count waiters, the semaphore isn't touched after that
+    void release(std::size_t count = 1)
+    {
+        std::unique_lock lock{mutex_};
+        // Permits are handed over directly, only the rest is kept
+        auto handed_over = std::min(count, waiting_);
+        permits_ += count - handed_over;
+        waiting_ -= handed_over;
+
+        waiters_.wake_while(lock, [&handed_over](OpBase* op)
+            {
+                if (handed_over == 0)
+                {
+                    return false;
+                }
+                --handed_over;
+                static_cast<WaiterBase*>(op)->parked = false;
+                return true;
+            });
+    }
+
+    ~AsyncSemaphore() noexcept
+    {
+        NG_ASSERTF(waiters_.empty(), "Semaphore destroyed while someone is waiting on it!");
+    }
+
+private:
+    void do_acquire(WaiterBase* op)
+    {
+        std::unique_lock lock{mutex_};
+        if (op->stopped)
+        {
+            lock.unlock();
+            op->cancel();
+            return;
+        }
+
+        if (permits_ > 0 && waiting_ == 0)
+        {
+            --permits_;
+            lock.unlock();
+            op->wake();
+            return;
+        }
+
+        op->parked = true;
+        ++waiting_;
+        waiters_.park(op);
+    }
+
+    void try_cancel(WaiterBase* op)
+    {
+        std::unique_lock lock{mutex_};
+        if (!op->parked)
+        {
+            // Either not parked yet, in which case do_acquire notices,
+            // or it already has its permit
+            op->stopped = true;
+            return;
+        }
+
+        waiters_.remove(op);
+        op->parked = false;
+        --waiting_;
+        lock.unlock();
+
+        op->cancel();
+    }
+
+private:
+    AdaptiveMutex mutex_;
+    std::size_t permits_;
+    std::size_t waiting_{0};
+    WaiterLot waiters_;
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <atomic>
+#include <cstdint>
 #include <utility>
 #include <array>
 
@@ -25,6 +26,13 @@ namespace detail
 
     template<std::size_t I, class T>
     using Second = T;
+
+    // 1 << 64 is UB, so the full width needs special care
+    template<std::size_t Size>
+    constexpr std::uint64_t low_bits_mask()
+    {
+        return Size >= 64 ? ~std::uint64_t{0} : (std::uint64_t{1} << Size) - 1;
+    }
 }
 
 
@@ -39,7 +47,7 @@ public:
 
     explicit AtomicUIntTuple(ValueType value) : impl_{encode(value)} {}
 
-    ValueType load(std::memory_order m = std::memory_order::seq_cst)
+    ValueType load(std::memory_order m = std::memory_order::seq_cst) const
         { return decode(impl_.load(m)); }
     void store(ValueType value, std::memory_order m = std::memory_order::seq_cst)
         { impl_.store(encode(value), m); }
@@ -47,41 +55,43 @@ public:
         { return decode(impl_.exchange(encode(value), m)); }
 
     template<bool Weak = false>
-    void compare_exchange(ValueType& expected, ValueType desired,
+    bool compare_exchange(ValueType& expected, ValueType desired,
         std::memory_order success = std::memory_order::seq_cst,
         std::memory_order failure = std::memory_order::seq_cst)
     {
         std::uint64_t old = encode(expected);
 
+        bool result;
         if constexpr (Weak)
-        { impl_.compare_exchange_weak(old, encode(desired), success, failure); }
+        { result = impl_.compare_exchange_weak(old, encode(desired), success, failure); }
         else
-        { impl_.compare_exchange_strong(old, encode(desired), success, failure); }
+        { result = impl_.compare_exchange_strong(old, encode(desired), success, failure); }
         
         expected = decode(old);
+        return result;
     }
 
 private:
-    std::uint64_t encode(ValueType value)
+    static std::uint64_t encode(ValueType value)
     {
         return
             [&]
             <std::size_t... Idxs, std::size_t... Szs, std::size_t... Offsets>
             (std::index_sequence<Idxs...>, std::index_sequence<Szs...>, std::index_sequence<Offsets...>)
             {
-                return (((std::get<Idxs>(value) & ((1 << Szs) - 1)) << Offsets) | ...);
+                return (((std::get<Idxs>(value) & detail::low_bits_mask<Szs>()) << Offsets) | ...);
             }
             (std::make_index_sequence<sizeof...(Sizes)>{}, std::index_sequence<Sizes...>{}, PrefixSums{});
     }
 
-    ValueType decode(std::uint64_t a)
+    static ValueType decode(std::uint64_t a)
     {
         ValueType result;
         [&]
         <std::size_t... Idxs, std::size_t... Szs, std::size_t... Offsets>
         (std::index_sequence<Idxs...>, std::index_sequence<Szs...>, std::index_sequence<Offsets...>)
         {
-            (..., (std::get<Idxs>(result) = (a >> Offsets) & ((1 << Szs) - 1)));
+            (..., (std::get<Idxs>(result) = (a >> Offsets) & detail::low_bits_mask<Szs>()));
         }
         (std::make_index_sequence<sizeof...(Sizes)>{}, std::index_sequence<Sizes...>{}, PrefixSums{});
         return result;
@@ -1,21 +1,75 @@
 #pragma once
 
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "unifex/get_stop_token.hpp"
+#include "unifex/stop_token_concepts.hpp"
+
+#include "concurrency/LockfreeQueue.hpp"
+#include "concurrency/OpParkingLot.hpp"
+#include "concurrency/SchedulerStats.hpp"
+#include "concurrency/ThreadAffinity.hpp"
 #include "util/Assert.hpp"
+#include "util/Trace.hpp"
 
 
 // Thread pool specifically for slow and blocking tasks
-// e.g. sync IO or blocking vulkan calls
+// e.g. sync IO or blocking vulkan calls.
+// Queued ops whose stop token gets triggered are removed right away.
+// Starts with min_threads and grows up to max_threads when every thread
+// has been stuck for a while, extra threads go away after idling.
 class BlockingThreadPool
 {
-    using ToStartLot = OpParkingLot<>;
+    using OpBase = OpParkingLot<>::OpBase;
 
-    using OpBase = ToStartLot::OpBase;
+    using Clock = WorkerCounters::Clock;
+
+    struct QueuedOpBase : OpBase
+    {
+        template<class Derived>
+        explicit QueuedOpBase(Derived* derived)
+            : OpBase(derived)
+        {
+        }
+
+        // Both are guarded by the pool's mutex
+        QueuedOpBase* prev{nullptr};
+        bool queued{false};
+        Clock::time_point enqueued_at;
+        [[no_unique_address]] TraceFlow flow;
+    };
 
     template<class Receiver>
-    struct Op : OpBase
+    struct Op : QueuedOpBase
     {
+        using StopToken = unifex::stop_token_type_t<Receiver>;
+        static constexpr bool CANCELLABLE = !unifex::is_stop_never_possible_v<StopToken>;
+
+        struct StopCallback
+        {
+            void operator()() noexcept
+            {
+                // Might destroy the op, including this callback
+                op->pool.try_cancel(op);
+            }
+
+            Op* op;
+        };
+
+        struct NoStopCallback {};
+
+        using StopCallbackStorage = std::conditional_t<CANCELLABLE,
+            std::optional<typename StopToken::template callback_type<StopCallback>>, NoStopCallback>;
+
         Op(BlockingThreadPool& p, auto&& rec)
-            : OpBase(this)
+            : QueuedOpBase(this)
             , pool{p}
             , receiver{std::forward<decltype(rec)>(rec)}
         {
@@ -23,25 +77,64 @@ class BlockingThreadPool
 
         void start() noexcept
         {
+            if constexpr (CANCELLABLE)
+            {
+                auto token = unifex::get_stop_token(receiver);
+                if (token.stop_requested())
+                {
+                    unifex::set_done(std::move(receiver));
+                    return;
+                }
+
+                // If stop gets requested before we are queued the callback does nothing,
+                // wake will notice it instead
+                if (token.stop_possible())
+                {
+                    stop_callback.emplace(token, StopCallback{this});
+                }
+            }
+
             pool.enqueue(this);
         }
         
         void wake()
         {
+            NG_TRACE_ZONE("BlockingThreadPool task");
+            this->flow.finish("BlockingThreadPool hop");
+
+            if constexpr (CANCELLABLE)
+            {
+                // Waits for a concurrently running callback, which will do nothing
+                stop_callback.reset();
+                if (unifex::get_stop_token(receiver).stop_requested())
+                {
+                    unifex::set_done(std::move(receiver));
+                    return;
+                }
+            }
+
             unifex::set_value(std::move(receiver));
         }
 
         void cancel()
         {
+            if constexpr (CANCELLABLE)
+            {
+                stop_callback.reset();
+            }
+
             unifex::set_done(std::move(receiver));
         }
 
         BlockingThreadPool& pool;
         Receiver receiver;
+        [[no_unique_address]] StopCallbackStorage stop_callback;
     };
+
 public:
     class Scheduler
     {
+    public:
         struct Sender
         {
             template <
@@ -76,65 +169,68 @@ public:
         BlockingThreadPool* pool_;
     };
 
-    
-    explicit BlockingThreadPool(std::size_t thread_count = std::thread::hardware_concurrency())
-    {
-        NG_ASSERT(thread_count > 0);
-        threads_.reserve(thread_count);
-        for (std::size_t i = 0; i < thread_count; ++i)
-        {
-            threads_.emplace_back([this]() { thread_loop(); });
-        }
-    }
+    // Don't spawn a thread for a blocking call that is about to return
+    static constexpr std::chrono::milliseconds SPAWN_DELAY{5};
+    static constexpr std::chrono::seconds IDLE_TIMEOUT{10};
+
+    // Thread slot i gets pinned to affinities[i % affinities.size()]
+    explicit BlockingThreadPool(std::size_t min_threads = 1,
+        std::size_t max_threads = std::thread::hardware_concurrency(),
+        std::vector<CpuSet> affinities = {});
 
     Scheduler get_scheduler() noexcept { return Scheduler{this}; }
 
-    void request_stop() noexcept
-    {
-        stop_requested_.store(true, std::memory_order::relaxed);
-        tasks_available_.notify_all();
-    }
+    // One entry per thread slot, including the ones without a thread right now
+    PoolStats stats();
 
-    ~BlockingThreadPool() noexcept
-    {
-        for (auto& thread : threads_)
-        {
-            thread.join();
-        }
-    }
+    void request_stop() noexcept;
+
+    ~BlockingThreadPool() noexcept;
 
 private:
-    void enqueue(OpBase* op)
-    {
-        std::unique_lock lock{mtx_};
-        awaiting_start_.park(op);
-        tasks_available_.notify_one();
-    }
+    void enqueue(QueuedOpBase* op);
+    void try_cancel(QueuedOpBase* op);
 
-    void thread_loop()
-    {
-        while (!stop_requested_.load(std::memory_order::relaxed))
-        {
-            std::unique_lock lock{mtx_};
-            while (!stop_requested_.load(std::memory_order::relaxed)
-                && !awaiting_start_.wake_one(lock))
-            {
-                tasks_available_.wait(lock);
-            }
-        }
+    // Everything below requires mtx_ to be locked
 
-        std::unique_lock lock{mtx_};
-        multi_cancel_all(lock, awaiting_start_);
-    }
+    void drain_incoming();
+    void unlink(QueuedOpBase* op);
+    QueuedOpBase* pop_waiting();
+    bool has_waiting();
+    void spawn_thread();
+    void join_exited(std::unique_lock<std::mutex>& lock);
+
+    void thread_loop(std::size_t slot);
+    void monitor_loop();
     
 private:
-    std::vector<std::thread> threads_;
+    std::size_t min_threads_;
+    std::size_t max_threads_;
+    std::vector<CpuSet> affinities_;
+
     std::mutex mtx_;
     std::condition_variable tasks_available_;
+    std::condition_variable monitor_wakeup_;
     std::atomic<bool> stop_requested_{false};
-    ToStartLot awaiting_start_;
-};
+    std::atomic<std::size_t> sleeping_count_{0};
 
+    // Producers push here without locking, workers move ops to the waiting list
+    LockfreeQueue<OpBase> incoming_;
+    // Doubly linked, so that cancelled ops can be unlinked in O(1)
+    QueuedOpBase* waiting_first_{nullptr};
+    QueuedOpBase* waiting_last_{nullptr};
 
+    // One slot per possible thread, exited threads are joined by the monitor
+    std::vector<std::thread> threads_;
+    std::vector<std::size_t> free_slots_;
+    std::vector<std::size_t> exited_slots_;
+    std::size_t thread_count_{0};
+    // Lets the monitor tell stuck threads from busy ones
+    std::uint64_t started_ops_{0};
+    std::size_t waiting_count_{0};
 
+    // Per thread slot, written by the thread currently occupying it
+    std::vector<WorkerCounters> counters_;
 
+    std::thread monitor_;
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <unifex/async_scope.hpp>
+#include <unifex/task.hpp>
+
+#include "concurrency/AsyncSemaphore.hpp"
+#include "util/Defer.hpp"
+
+
+// Like unifex::async_scope, but at most `limit` of the spawned senders run
+// at the same time, the rest wait for their turn in FIFO order.
+// Unlike StaticScope, spawning never waits and the limit is a runtime value.
+// Senders still waiting for their turn when stop is requested never run.
+class BoundedScope
+{
+public:
+    explicit BoundedScope(std::size_t limit)
+        : semaphore_{limit}
+    {
+        NG_ASSERT(limit > 0);
+    }
+
+    template<unifex::sender Sender>
+    void spawn(Sender&& sender)
+    {
+        scope_.spawn(run(std::forward<Sender>(sender)));
+    }
+
+    // Completes once everything spawned so far has finished,
+    // requesting stop from the ones that have started
+    auto cleanup()
+    {
+        return scope_.cleanup();
+    }
+
+private:
+    template<class Sender>
+    unifex::task<void> run(Sender sender)
+    {
+        // Completes with done on stop, which skips the rest
+        co_await semaphore_.acquire();
+        Defer release{[this]() { semaphore_.release(); }};
+        co_await std::move(sender);
+    }
+
+private:
+    AsyncSemaphore semaphore_;
+    unifex::async_scope scope_;
+};
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cstddef>
+
 
 constexpr std::size_t CACHELINE_SIZE = 64;
 
-[[no_unique_address]] struct alignas(CACHELINE_SIZE) CachelinePad {};
+struct alignas(CACHELINE_SIZE) CachelinePad {};
@@ -0,0 +1,236 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "concurrency/AdaptiveMutex.hpp"
+#include "concurrency/CachelinePad.hpp"
+#include "util/Mixins.hpp"
+
+
+// Insert-only hash map for registries that are read far more often than written.
+// Lookups take no locks, inserts only lock the shard the key falls into.
+// Entries are never moved or erased, so pointers to values stay valid for the
+// lifetime of the map. Shards use open addressing with linear probing over
+// pointers to entries, a grown table replaces the old one and the old one is
+// kept around until the map dies, as readers might still be probing it.
+template<class Key, class Value, class Hash = std::hash<Key>, std::size_t SHARD_COUNT = 16>
+class ConcurrentHashMap : public NoMove
+{
+    static_assert(std::has_single_bit(SHARD_COUNT));
+
+    static constexpr std::size_t MIN_CAPACITY = 16;
+
+    struct Entry
+    {
+        std::size_t hash;
+        Key key;
+        Value value;
+    };
+
+    struct Table
+    {
+        explicit Table(std::size_t cap)
+            : capacity{cap}
+            , slots{std::make_unique<std::atomic<Entry*>[]>(cap)}
+        {
+        }
+
+        std::size_t capacity;
+        std::unique_ptr<std::atomic<Entry*>[]> slots;
+    };
+
+    struct alignas(CACHELINE_SIZE) Shard
+    {
+        std::atomic<Table*> table{nullptr};
+        std::atomic<std::size_t> size{0};
+
+        AdaptiveMutex mutex;
+        // All the tables this shard ever had, the last one is current
+        std::vector<std::unique_ptr<Table>> tables; // guarded by mutex
+    };
+
+public:
+    explicit ConcurrentHashMap(Hash hash = Hash{})
+        : hash_{std::move(hash)}
+    {
+    }
+
+    ~ConcurrentHashMap() noexcept
+    {
+        for (auto& shard : shards_)
+        {
+            auto table = shard.table.load(std::memory_order::relaxed);
+            if (table == nullptr)
+            {
+                continue;
+            }
+
+            for (std::size_t i = 0; i < table->capacity; ++i)
+            {
+                delete table->slots[i].load(std::memory_order::relaxed);
+            }
+        }
+    }
+
+    Value* find(const Key& key)
+    {
+        auto entry = find_entry(key);
+        return entry != nullptr ? &entry->value : nullptr;
+    }
+
+    const Value* find(const Key& key) const
+    {
+        auto entry = find_entry(key);
+        return entry != nullptr ? &entry->value : nullptr;
+    }
+
+    bool contains(const Key& key) const
+    {
+        return find_entry(key) != nullptr;
+    }
+
+    // Constructs the value only if the key is missing.
+    // Returns the value in the map and whether it was inserted now.
+    template<class... Args>
+    std::pair<Value*, bool> try_emplace(Key key, Args&&... args)
+    {
+        auto hash = mix(hash_(key));
+        auto& shard = shard_for(hash);
+
+        std::lock_guard lock{shard.mutex};
+
+        auto table = shard.table.load(std::memory_order::relaxed);
+        if (table != nullptr)
+        {
+            if (auto existing = probe(*table, hash, key))
+            {
+                return {&existing->value, false};
+            }
+        }
+
+        // Keep the load factor at or below a half, so that probes stay short
+        auto size = shard.size.load(std::memory_order::relaxed);
+        if (table == nullptr || 2 * (size + 1) > table->capacity)
+        {
+            table = grow(shard, table);
+        }
+
+        auto entry = new Entry{hash, std::move(key), Value(std::forward<Args>(args)...)};
+        place(*table, entry, std::memory_order::release);
+        shard.size.store(size + 1, std::memory_order::relaxed);
+
+        return {&entry->value, true};
+    }
+
+    // Approximate while someone is inserting
+    std::size_t size() const
+    {
+        std::size_t result = 0;
+        for (auto& shard : shards_)
+        {
+            result += shard.size.load(std::memory_order::relaxed);
+        }
+        return result;
+    }
+
+private:
+    // std::hash is the identity for integers and pointers on most standard
+    // libraries, so the bits have to be mixed before they get picked apart
+    static std::size_t mix(std::size_t hash)
+    {
+        std::uint64_t h = hash;
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+        return static_cast<std::size_t>(h);
+    }
+
+    // Slots are picked by the low bits, so shards are picked by the high ones
+    Shard& shard_for(std::size_t hash)
+    {
+        if constexpr (SHARD_COUNT == 1)
+        {
+            return shards_[0];
+        }
+        else
+        {
+            return shards_[hash >> (8 * sizeof(std::size_t) - std::countr_zero(SHARD_COUNT))];
+        }
+    }
+
+    const Shard& shard_for(std::size_t hash) const
+    {
+        return const_cast<ConcurrentHashMap*>(this)->shard_for(hash);
+    }
+
+    Entry* find_entry(const Key& key) const
+    {
+        auto hash = mix(hash_(key));
+        auto table = shard_for(hash).table.load(std::memory_order::acquire);
+        return table != nullptr ? probe(*table, hash, key) : nullptr;
+    }
+
+    static Entry* probe(const Table& table, std::size_t hash, const Key& key)
+    {
+        auto mask = table.capacity - 1;
+        for (std::size_t i = hash & mask;; i = (i + 1) & mask)
+        {
+            auto entry = table.slots[i].load(std::memory_order::acquire);
+            if (entry == nullptr)
+            {
+                return nullptr;
+            }
+            if (entry->hash == hash && entry->key == key)
+            {
+                return entry;
+            }
+        }
+    }
+
+    static void place(Table& table, Entry* entry, std::memory_order order)
+    {
+        auto mask = table.capacity - 1;
+        auto i = entry->hash & mask;
+        while (table.slots[i].load(std::memory_order::relaxed) != nullptr)
+        {
+            i = (i + 1) & mask;
+        }
+        table.slots[i].store(entry, order);
+    }
+
+    // Should be called under the shard's lock
+    static Table* grow(Shard& shard, Table* old)
+    {
+        auto capacity = old != nullptr ? 2 * old->capacity : MIN_CAPACITY;
+        auto table = shard.tables.emplace_back(std::make_unique<Table>(capacity)).get();
+
+        if (old != nullptr)
+        {
+            for (std::size_t i = 0; i < old->capacity; ++i)
+            {
+                if (auto entry = old->slots[i].load(std::memory_order::relaxed))
+                {
+                    // Nobody sees the new table yet
+                    place(*table, entry, std::memory_order::relaxed);
+                }
+            }
+        }
+
+        shard.table.store(table, std::memory_order::release);
+        return table;
+    }
+
+private:
+    [[no_unique_address]] Hash hash_;
+    std::array<Shard, SHARD_COUNT> shards_;
+};
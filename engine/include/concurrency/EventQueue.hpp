@@ -1,11 +1,17 @@
 #pragma once
 
+#include <atomic>
+#include <vector>
 
-#include "concurrency/Spinlock.hpp"
+#include "concurrency/LockfreeQueue.hpp"
 #include "concurrency/OpParkingLot.hpp"
-#include <mutex>
+#include "concurrency/PooledTask.hpp"
+#include "concurrency/SchedulerStats.hpp"
+#include "concurrency/ThreadPool.hpp"
 
 
+// Events are split into two lanes: ordinary ones are executed one by one
+// on the draining thread, thread-safe ones can be spread over a thread pool.
 class EventQueue
 {
     using EventLot = OpParkingLot<>;
@@ -15,16 +21,17 @@ class EventQueue
     template<class Receiver>
     struct Op : OpBase
     {
-        Op(EventQueue& q, auto&& rec)
+        Op(EventQueue& q, auto&& rec, bool ts)
             : OpBase(this)
             , queue{q}
             , receiver{std::forward<decltype(rec)>(rec)}
+            , thread_safe{ts}
         {
         }
 
         void start() noexcept
         {
-            queue.enqueue(this);
+            queue.enqueue(this, thread_safe);
         }
         
         void wake()
@@ -39,6 +46,7 @@ class EventQueue
 
         EventQueue& queue;
         Receiver receiver;
+        bool thread_safe;
     };
 
 public:
@@ -59,51 +67,74 @@ public:
             template<unifex::receiver_of<> Receiver>
             auto connect(Receiver&& r)
             {
-                return Op<std::remove_cvref_t<Receiver>>{*queue, std::forward<Receiver>(r)};
+                return Op<std::remove_cvref_t<Receiver>>{*queue, std::forward<Receiver>(r), thread_safe};
             }
 
             EventQueue* queue;
+            bool thread_safe;
         };
     public:
-        explicit Scheduler(EventQueue* queue) : queue_{queue} {}
+        Scheduler(EventQueue* queue, bool thread_safe) : queue_{queue}, thread_safe_{thread_safe} {}
 
         Sender schedule() const
         {
-            return Sender{queue_};
+            return Sender{queue_, thread_safe_};
         }
 
         friend bool operator==(const Scheduler& a, const Scheduler& b) = default;
 
     private:
         EventQueue* queue_;
+        bool thread_safe_;
     };
 
-    Scheduler get_scheduler() noexcept
+    // Thread-safe events may get resumed on any thread of the pool, in any order
+    Scheduler get_scheduler(bool thread_safe = false) noexcept
     {
-	    return Scheduler(this);
+	    return Scheduler(this, thread_safe);
     }
 
-    void executeAll()
-    {
-        std::unique_lock lock{lock_};
-        events_.wake_all(lock);
-    }
+    // Executes both lanes on the calling thread.
+    // Should only be called from a single thread at a time.
+    void executeAll();
 
-    ~EventQueue() noexcept
-    {
-        std::unique_lock lock{lock_};
-        multi_cancel_all(lock, events_);
-    }
+    // Executes only the events that are not thread-safe, on the calling thread.
+    // Should only be called from a single thread at a time.
+    void executeSerial();
+
+    // Spreads the thread-safe events over the pool and completes on one of its threads.
+    // Should only be called from a single thread at a time.
+    PooledTask<void> executeConcurrent(ThreadPool::Scheduler scheduler);
+
+    // Only a hint unless called by the draining thread
+    bool hasConcurrent() const { return !concurrent_events_.empty(); }
+
+    // Can be called from any thread
+    EventQueueStats stats() const;
+
+    ~EventQueue() noexcept;
 
 private:
-    void enqueue(OpBase* op)
+    void enqueue(OpBase* op, bool thread_safe)
     {
-        std::unique_lock lock{lock_};
-        events_.park(op);
+        (thread_safe ? concurrent_events_ : events_).push(op);
     }
 
+    // Returns the amount of events woken
+    static std::size_t wakeAll(OpBase* current);
+
+    void recordDrain(std::atomic<std::uint64_t>& total, std::atomic<std::size_t>& last, std::size_t count);
+
 
 private:
-    Spinlock lock_;
-    EventLot events_;
+    LockfreeQueue<OpBase> events_;
+    LockfreeQueue<OpBase> concurrent_events_;
+    // Reused between drains to avoid allocating every frame
+    std::vector<OpBase*> concurrent_batch_;
+
+    // Only written by the draining thread
+    std::atomic<std::uint64_t> serial_executed_{0};
+    std::atomic<std::uint64_t> concurrent_executed_{0};
+    std::atomic<std::size_t> last_serial_batch_{0};
+    std::atomic<std::size_t> last_concurrent_batch_{0};
 };
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+
+
+// Size-class pool for coroutine frames and other small, short-lived blocks.
+// Every thread keeps a small cache of free blocks per size class, so allocating
+// and freeing a frame is usually a couple of pointer writes. Frames are often
+// freed on a different thread than the one that allocated them, so caches
+// exchange blocks with a shared central list in batches.
+// Blocks are never given back to the OS while the program is running.
+class FrameAllocator
+{
+public:
+    // Bigger frames go straight to the global heap
+    static constexpr std::size_t MAX_POOLED_SIZE = 16384;
+
+    static void* allocate(std::size_t size);
+
+    // size has to be the same one the block was allocated with
+    static void deallocate(void* ptr, std::size_t size) noexcept;
+
+    // How many bytes a block allocated with the given size can actually hold
+    static std::size_t usable_size(std::size_t size) noexcept;
+};
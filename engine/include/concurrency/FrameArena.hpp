@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+#include "concurrency/AdaptiveMutex.hpp"
+#include "util/Mixins.hpp"
+
+
+// Linear allocator for data that lives for a single frame.
+// Every thread bumps a pointer in its own chunks, deallocation does nothing
+// and everything is released at once when the arena is leased for a new frame.
+// Chunks are kept around, so after a couple of frames no memory is requested
+// from the heap anymore.
+class FrameArena : public std::pmr::memory_resource, public NoMove
+{
+    struct Region;
+
+public:
+    // Allocations made by a single thread in a row come out of chunks this big
+    static constexpr std::size_t CHUNK_SIZE = 64 * 1024;
+
+    // The arena stays valid and untouched for as long as the lease is alive
+    class Lease
+    {
+    public:
+        Lease() = default;
+
+        Lease(Lease&& other) noexcept
+            : arena_{std::exchange(other.arena_, nullptr)}
+        {
+        }
+
+        Lease& operator=(Lease&& other) noexcept
+        {
+            if (this != &other)
+            {
+                release();
+                arena_ = std::exchange(other.arena_, nullptr);
+            }
+            return *this;
+        }
+
+        ~Lease() noexcept { release(); }
+
+        explicit operator bool() const { return arena_ != nullptr; }
+
+        // Falls back to the default resource for an empty lease
+        std::pmr::memory_resource* resource() const
+        {
+            return arena_ != nullptr ? arena_ : std::pmr::get_default_resource();
+        }
+
+    private:
+        friend class FrameArena;
+
+        explicit Lease(FrameArena* arena) : arena_{arena} {}
+
+        void release() noexcept
+        {
+            if (arena_ != nullptr)
+            {
+                arena_->leased_.store(false, std::memory_order::release);
+                arena_ = nullptr;
+            }
+        }
+
+    private:
+        FrameArena* arena_{nullptr};
+    };
+
+    FrameArena();
+    ~FrameArena() noexcept override;
+
+    // Drops everything allocated during the previous lease,
+    // returns an empty lease if the arena is still in use
+    Lease try_lease();
+
+private:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+    void do_deallocate(void*, std::size_t, std::size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+
+    Region& region_for_this_thread();
+
+private:
+    // Never reused, so stale per-thread entries of dead arenas are never looked at
+    std::size_t id_;
+    std::atomic<bool> leased_{false};
+
+    AdaptiveMutex mutex_;
+    std::vector<std::unique_ptr<Region>> regions_; // guarded by mutex_
+};
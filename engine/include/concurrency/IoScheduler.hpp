@@ -0,0 +1,262 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <mutex>
+#include <span>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <unifex/task.hpp>
+
+#include "unifex/receiver_concepts.hpp"
+#include "unifex/sender_concepts.hpp"
+
+#include "concurrency/BlockingThreadPool.hpp"
+#include "concurrency/OpParkingLot.hpp"
+#include "concurrency/ThreadPool.hpp"
+
+
+// Read-only file opened for async reads. Closed on destruction.
+class AsyncFile
+{
+public:
+    // Throws std::system_error if the file can't be opened
+    explicit AsyncFile(const std::filesystem::path& path);
+
+    AsyncFile(const AsyncFile&) = delete;
+    AsyncFile& operator=(const AsyncFile&) = delete;
+    AsyncFile(AsyncFile&& other) noexcept;
+    AsyncFile& operator=(AsyncFile&& other) noexcept;
+
+    ~AsyncFile() noexcept;
+
+    std::uint64_t size() const;
+
+    // Blocking read, returns the amount of bytes read or a negative error code
+    std::int64_t read_at(std::span<std::byte> buffer, std::uint64_t offset) const noexcept;
+
+    std::intptr_t native_handle() const noexcept { return handle_; }
+
+private:
+    void close() noexcept;
+
+private:
+    std::intptr_t handle_;
+};
+
+/**
+ * Async file reading. On Linux reads go through io_uring and a single thread
+ * reaps their completions, elsewhere (or when io_uring is not available)
+ * they are done on the blocking pool.
+ * Either way, results are delivered on the thread pool passed to the constructor.
+ */
+class IoScheduler
+{
+    // The argument is the amount of bytes read or a negative error code
+    using OpBase = OpParkingLot<std::int64_t>::OpBase;
+
+    struct ReadOpBase : OpBase
+    {
+        template<class Derived>
+        ReadOpBase(Derived* derived, const AsyncFile* f, std::span<std::byte> buf, std::uint64_t off)
+            : OpBase(derived)
+            , file{f}
+            , buffer{buf}
+            , offset{off}
+        {
+        }
+
+        const AsyncFile* file;
+        std::span<std::byte> buffer;
+        std::uint64_t offset;
+    };
+
+    template<class Receiver>
+    struct ReadOp : ReadOpBase
+    {
+        struct ResumeReceiver
+        {
+            void set_value() && noexcept
+            {
+                if (op->result < 0)
+                {
+                    unifex::set_error(std::move(op->receiver), std::make_exception_ptr(
+                        std::system_error(static_cast<int>(-op->result), std::generic_category(), "File read failed")));
+                    return;
+                }
+
+                unifex::set_value(std::move(op->receiver), static_cast<std::size_t>(op->result));
+            }
+
+            void set_done() && noexcept
+            {
+                unifex::set_done(std::move(op->receiver));
+            }
+
+            void set_error(std::exception_ptr e) && noexcept
+            {
+                unifex::set_error(std::move(op->receiver), std::move(e));
+            }
+
+            ReadOp* op;
+        };
+
+        // Only used when io_uring is not available
+        struct FallbackReceiver
+        {
+            void set_value() && noexcept
+            {
+                op->wake(op->file->read_at(op->buffer, op->offset));
+            }
+
+            void set_done() && noexcept
+            {
+                unifex::set_done(std::move(op->receiver));
+            }
+
+            ReadOp* op;
+        };
+
+        ReadOp(IoScheduler& s, auto&& rec, const AsyncFile* f, std::span<std::byte> buf, std::uint64_t off)
+            : ReadOpBase(this, f, buf, off)
+            , io{s}
+            , receiver{std::forward<decltype(rec)>(rec)}
+            , resume{unifex::connect(s.resume_scheduler_.schedule(), ResumeReceiver{this})}
+            , fallback{unifex::connect(s.fallback_scheduler_.schedule(), FallbackReceiver{this})}
+        {
+        }
+
+        void start() noexcept
+        {
+            if (!io.submit(this))
+            {
+                unifex::start(fallback);
+            }
+        }
+
+        // Called from the reaper or a blocking thread, so just hop to the pool
+        void wake(std::int64_t res)
+        {
+            result = res;
+            unifex::start(resume);
+        }
+
+        void cancel()
+        {
+            unifex::set_done(std::move(receiver));
+        }
+
+        IoScheduler& io;
+        Receiver receiver;
+        std::int64_t result{0};
+        unifex::connect_result_t<ThreadPool::Scheduler::Sender, ResumeReceiver> resume;
+        unifex::connect_result_t<BlockingThreadPool::Scheduler::Sender, FallbackReceiver> fallback;
+    };
+
+public:
+    // Sends the amount of bytes read, which is less than requested only at the end of the file
+    struct ReadSender
+    {
+        template <
+            template <typename...> class Variant,
+            template <typename...> class Tuple>
+        using value_types = Variant<Tuple<std::size_t>>;
+
+        template <template <typename...> class Variant>
+        using error_types = Variant<std::exception_ptr>;
+
+        static constexpr bool sends_done = true;
+
+        template<class Receiver>
+        auto connect(Receiver&& r)
+        {
+            return ReadOp<std::remove_cvref_t<Receiver>>(*io, std::forward<Receiver>(r), file, buffer, offset);
+        }
+
+        IoScheduler* io;
+        const AsyncFile* file;
+        std::span<std::byte> buffer;
+        std::uint64_t offset;
+    };
+
+
+    IoScheduler(ThreadPool::Scheduler resume_scheduler, BlockingThreadPool::Scheduler fallback_scheduler,
+        std::size_t queue_depth = 128);
+
+    // Both the file and the buffer have to outlive the operation
+    ReadSender read_some(const AsyncFile& file, std::span<std::byte> buffer, std::uint64_t offset)
+    {
+        return ReadSender{this, &file, buffer, offset};
+    }
+
+    // Reads up to size bytes starting at offset, the result is shorter if the file ends earlier
+    unifex::task<std::vector<std::byte>> read_range(std::filesystem::path path,
+        std::uint64_t offset, std::size_t size);
+
+    unifex::task<std::vector<std::byte>> read_file(std::filesystem::path path);
+
+    bool uses_io_uring() const noexcept { return ring_fd_ >= 0; }
+
+    // Reads that are still queued get cancelled
+    void request_stop() noexcept;
+
+    ~IoScheduler() noexcept;
+
+private:
+    static unifex::task<std::size_t> read_exactly(IoScheduler& io, const AsyncFile& file,
+        std::span<std::byte> buffer, std::uint64_t offset);
+
+    // Returns false if the op has to go to the fallback pool
+    bool submit(ReadOpBase* op);
+
+    // All of these require mtx_ to be locked
+    void push_sqe(ReadOpBase* op);
+    // Submits everything in the ring the kernel hasn't taken yet, retrying while it is busy
+    void flush_sqes();
+    void submit_pending();
+
+    bool setup_ring(std::size_t queue_depth);
+    void destroy_ring() noexcept;
+
+    void reaper_loop();
+
+private:
+    ThreadPool::Scheduler resume_scheduler_;
+    BlockingThreadPool::Scheduler fallback_scheduler_;
+
+    int ring_fd_{-1};
+
+    // Kernel-shared ring memory
+    void* sq_ring_{nullptr};
+    std::size_t sq_ring_size_{0};
+    void* cq_ring_{nullptr};
+    std::size_t cq_ring_size_{0};
+    void* sqes_{nullptr};
+    std::size_t sqes_size_{0};
+
+    unsigned* sq_head_{nullptr};
+    unsigned* sq_tail_{nullptr};
+    unsigned* sq_array_{nullptr};
+    unsigned sq_mask_{0};
+    unsigned sq_entries_{0};
+
+    unsigned* cq_head_{nullptr};
+    unsigned* cq_tail_{nullptr};
+    void* cqes_{nullptr};
+    unsigned cq_mask_{0};
+
+    // Guards the submission queue and everything below
+    std::mutex mtx_;
+    std::size_t in_flight_{0};
+    bool stop_requested_{false};
+    // Waits for a free slot in the ring
+    OpBase* pending_first_{nullptr};
+    OpBase* pending_last_{nullptr};
+
+    std::thread reaper_;
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+
+struct LockStats
+{
+    // Acquisitions that didn't get the lock right away
+    std::uint64_t contended{0};
+    // Out of those, the ones that had to go to sleep
+    std::uint64_t parked{0};
+
+    LockStats& operator+=(const LockStats& other)
+    {
+        contended += other.contended;
+        parked += other.parked;
+        return *this;
+    }
+
+    LockStats& operator-=(const LockStats& other)
+    {
+        contended -= other.contended;
+        parked -= other.parked;
+        return *this;
+    }
+};
+
+// Only touched on the slow paths, so plain shared counters are good enough
+class LockCounters
+{
+public:
+    void contended() { contended_.fetch_add(1, std::memory_order::relaxed); }
+    void parked() { parked_.fetch_add(1, std::memory_order::relaxed); }
+
+    LockStats snapshot() const
+    {
+        return LockStats{
+            .contended = contended_.load(std::memory_order::relaxed),
+            .parked = parked_.load(std::memory_order::relaxed),
+        };
+    }
+
+private:
+    std::atomic<std::uint64_t> contended_{0};
+    std::atomic<std::uint64_t> parked_{0};
+};
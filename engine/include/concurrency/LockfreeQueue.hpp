@@ -2,64 +2,116 @@
 
 #include <atomic>
 #include <concepts>
-#include <CachelinePad.hpp>
+
+#include "concurrency/CachelinePad.hpp"
 
 
 template<class T>
-concept QueueNode = requires(T t) { { t.node } -> std::same_as<std::atomic<T*>> }; 
+concept QueueNode = requires(T t) { { t.next } -> std::same_as<T*&>; };
 
+// Intrusive multi-producer single-consumer queue.
+// Producers push onto a lock-free stack, the consumer grabs the whole stack
+// at once and reverses it into a private FIFO list, so push is a single CAS
+// and pop is wait-free most of the time.
+// The node's next pointer doesn't need to be atomic: it is written before
+// the releasing CAS and read only after the acquiring exchange.
+// push and the grab are seq_cst so that the queue can be used in Dekker-style
+// "publish, then check for sleepers" protocols.
 template<QueueNode Node>
 class LockfreeQueue
 {
 public:
+    LockfreeQueue() = default;
+    LockfreeQueue(const LockfreeQueue&) = delete;
+    LockfreeQueue& operator=(const LockfreeQueue&) = delete;
+
+    // Can be called from any thread
     void push(Node* node)
     {
-        Node* last = last_.load();
-        Node* next = nullptr;
+        Node* head = head_.load(std::memory_order::relaxed);
+        do
+        {
+            node->next = head;
+        }
+        while (!head_.compare_exchange_weak(head, node,
+            std::memory_order::seq_cst, std::memory_order::relaxed));
+    }
 
-        while (true)
+    // Consumer only
+    Node* pop()
+    {
+        if (first_ == nullptr)
         {
-            next = last->next.load();
-            if (next != nullptr)
-            {
-                last_.compare_exchange_weak(last, next);
-                continue;
-            }
+            grab();
+        }
 
-            if (last->next.compare_exchange_weak(next, op))
+        auto result = first_;
+        if (result != nullptr)
+        {
+            first_ = result->next;
+            if (first_ == nullptr)
             {
-                break;
+                last_ = nullptr;
             }
         }
+        return result;
+    }
 
-        // We succeeded and now last->next == op, so help other threads to advance the tail
-        last_.compare_exchange_weak(last, op);
+    // Consumer only. Returns everything pushed so far as a FIFO list linked through next.
+    Node* pop_all()
+    {
+        grab();
+        auto result = first_;
+        first_ = nullptr;
+        last_ = nullptr;
+        return result;
     }
 
-    Node* pop()
+    // Approximate unless called by the consumer
+    bool empty() const
     {
-        Node* first = first_.load();
-        Node* next = nullptr;
+        return first_ == nullptr && head_.load(std::memory_order::seq_cst) == nullptr;
+    }
 
-        do
+private:
+    void grab()
+    {
+        Node* current = head_.exchange(nullptr, std::memory_order::seq_cst);
+        if (current == nullptr)
         {
-            next = first->next.load();
+            return;
         }
-        while (first_.compare_exchange_weak(first, next));
 
-        return first;
+        Node* reversed = nullptr;
+        Node* reversed_last = current;
+        while (current != nullptr)
+        {
+            auto next = current->next;
+            current->next = reversed;
+            reversed = current;
+            current = next;
+        }
+
+        if (last_ == nullptr)
+        {
+            first_ = reversed;
+        }
+        else
+        {
+            last_->next = reversed;
+        }
+        last_ = reversed_last;
     }
 
 private:
-    CachelinePad;
-    std::atomic<Node*> first_;
-    CachelinePad;
-    std::atomic<Node*> last_;
+    alignas(CACHELINE_SIZE) std::atomic<Node*> head_{nullptr};
+    // Consumer's private part
+    alignas(CACHELINE_SIZE) Node* first_{nullptr};
+    Node* last_{nullptr};
 };
 
 namespace detail
 {
-    struct NodeTest { std::atomic<NodeTest*> next; };
+    struct NodeTest { NodeTest* next; };
     static_assert(sizeof(LockfreeQueue<NodeTest>) == CACHELINE_SIZE*2);
 }
-
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "concurrency/CachelinePad.hpp"
+
+
+struct MemoryStats
+{
+    std::uint64_t allocations{0};
+    std::uint64_t frees{0};
+    // Requested sizes, not the sizes of the blocks that were handed out
+    std::uint64_t bytes_allocated{0};
+    std::uint64_t bytes_freed{0};
+
+    // Only meaningful for a snapshot, not for a difference of two
+    std::uint64_t live_bytes() const { return bytes_allocated - bytes_freed; }
+
+    MemoryStats& operator+=(const MemoryStats& other)
+    {
+        allocations += other.allocations;
+        frees += other.frees;
+        bytes_allocated += other.bytes_allocated;
+        bytes_freed += other.bytes_freed;
+        return *this;
+    }
+
+    MemoryStats& operator-=(const MemoryStats& other)
+    {
+        allocations -= other.allocations;
+        frees -= other.frees;
+        bytes_allocated -= other.bytes_allocated;
+        bytes_freed -= other.bytes_freed;
+        return *this;
+    }
+};
+
+// One per subsystem whose allocations we want to see. Relaxed shared counters,
+// kept on their own cacheline so that they don't slow down their neighbours.
+class alignas(CACHELINE_SIZE) MemoryCounters
+{
+public:
+    void allocated(std::uint64_t bytes)
+    {
+        allocations_.fetch_add(1, std::memory_order::relaxed);
+        bytes_allocated_.fetch_add(bytes, std::memory_order::relaxed);
+    }
+
+    void freed(std::uint64_t bytes)
+    {
+        frees_.fetch_add(1, std::memory_order::relaxed);
+        bytes_freed_.fetch_add(bytes, std::memory_order::relaxed);
+    }
+
+    // Grown or shrunk in place, no block changed hands
+    void resized(std::uint64_t old_bytes, std::uint64_t new_bytes)
+    {
+        bytes_allocated_.fetch_add(new_bytes, std::memory_order::relaxed);
+        bytes_freed_.fetch_add(old_bytes, std::memory_order::relaxed);
+    }
+
+    MemoryStats snapshot() const
+    {
+        return MemoryStats{
+            .allocations = allocations_.load(std::memory_order::relaxed),
+            .frees = frees_.load(std::memory_order::relaxed),
+            .bytes_allocated = bytes_allocated_.load(std::memory_order::relaxed),
+            .bytes_freed = bytes_freed_.load(std::memory_order::relaxed),
+        };
+    }
+
+private:
+    std::atomic<std::uint64_t> allocations_{0};
+    std::atomic<std::uint64_t> frees_{0};
+    std::atomic<std::uint64_t> bytes_allocated_{0};
+    std::atomic<std::uint64_t> bytes_freed_{0};
+};
@@ -59,6 +59,33 @@ public:
         push(op);
     }
 
+    bool empty() const
+    {
+        return first_ == nullptr;
+    }
+
+    // Takes op out of the lot if it is still parked, linear in the amount of parked ops
+    bool remove(OpBase* op)
+    {
+        OpBase* prev = nullptr;
+        for (auto current = first_; current != nullptr; prev = current, current = current->next)
+        {
+            if (current != op)
+            {
+                continue;
+            }
+
+            (prev != nullptr ? prev->next : first_) = op->next;
+            if (last_ == op)
+            {
+                last_ = prev;
+            }
+            op->next = nullptr;
+            return true;
+        }
+        return false;
+    }
+
     template<class T>
     bool wake_one(std::unique_lock<T>& lock, WakeArgs... args)
     {
@@ -71,6 +98,39 @@ public:
         return false;
     }
 
+    // Wakes ops from the front for as long as pred accepts them.
+    // pred runs under the lock, so it may update the owner's state.
+    template<class T, class Pred>
+    void wake_while(std::unique_lock<T>& lock, Pred pred)
+        requires (sizeof...(WakeArgs) == 0)
+    {
+        OpBase* woken_first = nullptr;
+        OpBase* woken_last = nullptr;
+        while (first_ != nullptr && pred(first_))
+        {
+            auto op = pop();
+            op->next = nullptr;
+            if (woken_last == nullptr)
+            {
+                woken_first = op;
+            }
+            else
+            {
+                woken_last->next = op;
+            }
+            woken_last = op;
+        }
+        lock.unlock();
+
+        while (woken_first != nullptr)
+        {
+            auto next = woken_first->next;
+            // wake might delete the op
+            woken_first->wake();
+            woken_first = next;
+        }
+    }
+
     template<class T>
     void wake_all(std::unique_lock<T>& lock)
         requires (sizeof...(WakeArgs) == 0)
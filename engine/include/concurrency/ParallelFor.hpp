@@ -0,0 +1,253 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <concepts>
+#include <exception>
+#include <type_traits>
+
+#include "unifex/receiver_concepts.hpp"
+#include "unifex/sender_concepts.hpp"
+
+#include "concurrency/ThreadPool.hpp"
+#include "util/Assert.hpp"
+#include "util/HeapArray.hpp"
+
+
+namespace detail
+{
+
+template<class Fn>
+concept RangeBody = std::invocable<Fn&, std::size_t, std::size_t>;
+
+template<class Fn>
+concept IndexBody = std::invocable<Fn&, std::size_t>;
+
+template<class Fn, class Receiver>
+class ParallelForOp
+{
+    struct WorkerReceiver
+    {
+        void set_value() && noexcept
+        {
+            op->run();
+            op->worker_finished();
+        }
+
+        void set_done() && noexcept
+        {
+            op->done_.store(true, std::memory_order::relaxed);
+            op->worker_finished();
+        }
+
+        void set_error(std::exception_ptr e) && noexcept
+        {
+            op->fail(std::move(e));
+            op->worker_finished();
+        }
+
+        ParallelForOp* op;
+    };
+
+    using WorkerOp = unifex::connect_result_t<ThreadPool::Scheduler::Sender, WorkerReceiver>;
+
+    // Immovable, so it has to be constructed in place
+    struct Worker
+    {
+        explicit Worker(ParallelForOp* op)
+            : inner{unifex::connect(op->scheduler_.schedule(), WorkerReceiver{op})}
+        {
+        }
+
+        WorkerOp inner;
+    };
+
+public:
+    ParallelForOp(ThreadPool::Scheduler scheduler, std::size_t count, std::size_t grain,
+        auto&& fn, auto&& rec)
+        : scheduler_{scheduler}
+        , count_{count}
+        , grain_{std::max<std::size_t>(grain, 1)}
+        , fn_{std::forward<decltype(fn)>(fn)}
+        , receiver_{std::forward<decltype(rec)>(rec)}
+    {
+    }
+
+    ParallelForOp(const ParallelForOp&) = delete;
+    ParallelForOp& operator=(const ParallelForOp&) = delete;
+
+    void start() noexcept
+    {
+        if (count_ == 0)
+        {
+            unifex::set_value(std::move(receiver_));
+            return;
+        }
+
+        // More workers than threads would only add scheduling overhead
+        auto chunks = (count_ + grain_ - 1) / grain_;
+        auto worker_count = std::min(chunks, std::max<std::size_t>(scheduler_.thread_count(), 1));
+
+        workers_ = HeapArray<Worker>(worker_count);
+        worker_count_ = worker_count;
+        running_workers_.store(worker_count, std::memory_order::relaxed);
+
+        for (std::size_t i = 0; i < worker_count; ++i)
+        {
+            workers_.emplace_back(this);
+        }
+
+        // The last worker to finish might destroy us, so don't touch members in the loop
+        auto* workers = workers_.begin();
+        for (std::size_t i = 0; i < worker_count; ++i)
+        {
+            unifex::start(workers[i].inner);
+        }
+    }
+
+private:
+    // Guided self-scheduling: chunks shrink as the range runs out,
+    // so late workers can still balance the tail of the loop
+    bool claim(std::size_t& begin, std::size_t& end)
+    {
+        auto current = next_.load(std::memory_order::relaxed);
+        do
+        {
+            if (current >= count_)
+            {
+                return false;
+            }
+
+            auto chunk = std::max(grain_, (count_ - current) / (2 * worker_count_));
+            begin = current;
+            end = std::min(count_, current + chunk);
+        }
+        while (!next_.compare_exchange_weak(current, end, std::memory_order::relaxed));
+
+        return true;
+    }
+
+    void run() noexcept
+    {
+        std::size_t begin;
+        std::size_t end;
+        while (claim(begin, end))
+        {
+            try
+            {
+                if constexpr (RangeBody<Fn>)
+                {
+                    fn_(begin, end);
+                }
+                else
+                {
+                    for (auto i = begin; i < end; ++i)
+                    {
+                        fn_(i);
+                    }
+                }
+            }
+            catch (...)
+            {
+                fail(std::current_exception());
+                return;
+            }
+        }
+    }
+
+    void fail(std::exception_ptr e) noexcept
+    {
+        if (!failed_.exchange(true, std::memory_order::relaxed))
+        {
+            exception_ = std::move(e);
+        }
+        // Stop everyone from claiming more work
+        next_.store(count_, std::memory_order::relaxed);
+    }
+
+    void worker_finished() noexcept
+    {
+        // acq_rel makes every worker's writes visible to the receiver
+        if (running_workers_.fetch_sub(1, std::memory_order::acq_rel) != 1)
+        {
+            return;
+        }
+
+        if (failed_.load(std::memory_order::relaxed))
+        {
+            unifex::set_error(std::move(receiver_), std::move(exception_));
+        }
+        else if (done_.load(std::memory_order::relaxed))
+        {
+            unifex::set_done(std::move(receiver_));
+        }
+        else
+        {
+            unifex::set_value(std::move(receiver_));
+        }
+    }
+
+private:
+    ThreadPool::Scheduler scheduler_;
+    std::size_t count_;
+    std::size_t grain_;
+    std::size_t worker_count_{0};
+    Fn fn_;
+    Receiver receiver_;
+
+    std::atomic<std::size_t> next_{0};
+    std::atomic<std::size_t> running_workers_{0};
+    std::atomic<bool> failed_{false};
+    std::atomic<bool> done_{false};
+    std::exception_ptr exception_;
+
+    HeapArray<Worker> workers_;
+};
+
+template<class Fn>
+struct ParallelForSender
+{
+    template <
+        template <typename...> class Variant,
+        template <typename...> class Tuple>
+    using value_types = Variant<Tuple<>>;
+
+    template <template <typename...> class Variant>
+    using error_types = Variant<std::exception_ptr>;
+
+    static constexpr bool sends_done = true;
+
+    template<class Receiver>
+    auto connect(Receiver&& r) &&
+    {
+        return ParallelForOp<Fn, std::remove_cvref_t<Receiver>>(
+            scheduler, count, grain, std::move(fn), std::forward<Receiver>(r));
+    }
+
+    template<class Receiver>
+    auto connect(Receiver&& r) const &
+    {
+        return ParallelForOp<Fn, std::remove_cvref_t<Receiver>>(
+            scheduler, count, grain, fn, std::forward<Receiver>(r));
+    }
+
+    ThreadPool::Scheduler scheduler;
+    std::size_t count;
+    std::size_t grain;
+    Fn fn;
+};
+
+}
+
+/**
+ * Runs fn over [0, count) on the pool and completes once everything is done.
+ * fn is either called as fn(i) for every index or as fn(begin, end) for whole chunks.
+ * Chunks are never smaller than grain (except for the last one).
+ * The first exception thrown by fn is propagated, the rest of the range is skipped.
+ */
+template<class Fn>
+    requires detail::RangeBody<std::decay_t<Fn>> || detail::IndexBody<std::decay_t<Fn>>
+auto parallel_for(ThreadPool::Scheduler scheduler, std::size_t count, Fn&& fn, std::size_t grain = 1)
+{
+    return detail::ParallelForSender<std::decay_t<Fn>>{scheduler, count, grain, std::forward<Fn>(fn)};
+}
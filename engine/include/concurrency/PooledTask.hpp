@@ -0,0 +1,419 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+#include <unifex/get_stop_token.hpp>
+#include <unifex/inplace_stop_token.hpp>
+#include <unifex/receiver_concepts.hpp>
+#include <unifex/sender_concepts.hpp>
+#include <unifex/stop_token_concepts.hpp>
+
+#include "concurrency/FrameAllocator.hpp"
+
+
+// Lazy coroutine task whose frame comes from the FrameAllocator.
+// Use it for coroutines that get created every frame.
+// It is a sender, so it can be awaited from an unifex::task or spawned into a scope,
+// and it can await any sender itself. If an awaited sender completes with done,
+// the rest of the body is skipped and the task completes with done too.
+// Stop requests of whoever awaits the task reach every sender it awaits.
+template<class T>
+class PooledTask;
+
+namespace detail
+{
+    // Result of co_await on a sender, void for senders without a value
+    template<class... Values>
+    struct AwaitedValue;
+
+    template<>
+    struct AwaitedValue<>
+    {
+        using type = void;
+    };
+
+    template<class Value>
+    struct AwaitedValue<Value>
+    {
+        using type = Value;
+    };
+
+    template<class... Alternatives>
+    struct OnlyAlternative
+    {
+        static_assert(sizeof...(Alternatives) == 0, "Awaited senders may only complete in one way");
+        using type = void;
+    };
+
+    template<class Alternative>
+    struct OnlyAlternative<Alternative>
+    {
+        using type = typename Alternative::type;
+    };
+
+    template<class Sender>
+    using awaited_value_t = typename unifex::sender_traits<std::remove_cvref_t<Sender>>
+        ::template value_types<OnlyAlternative, AwaitedValue>::type;
+
+    class PooledTaskPromiseBase
+    {
+        struct FinalAwaiter
+        {
+            bool await_ready() const noexcept { return false; }
+
+            // Completing might destroy the frame, so nothing may touch it afterwards
+            template<class Promise>
+            void await_suspend(std::coroutine_handle<Promise> coro) noexcept
+            {
+                coro.promise().op->complete();
+            }
+
+            void await_resume() const noexcept {}
+        };
+
+    public:
+        // The operation that started the coroutine and gets its result
+        struct OpBase
+        {
+            using CompleteFunc = void (*)(OpBase*);
+
+            template<class Derived>
+            explicit OpBase(Derived*)
+                : complete_type_erased{+[](OpBase* op) { static_cast<Derived*>(op)->complete(); }}
+                , done_type_erased{+[](OpBase* op) { static_cast<Derived*>(op)->done(); }}
+            {
+            }
+
+            void complete()
+            {
+                complete_type_erased(this);
+            }
+
+            void done()
+            {
+                done_type_erased(this);
+            }
+
+            CompleteFunc complete_type_erased;
+            CompleteFunc done_type_erased;
+        };
+
+        static void* operator new(std::size_t size)
+        {
+            return FrameAllocator::allocate(size);
+        }
+
+        static void operator delete(void* ptr, std::size_t size) noexcept
+        {
+            FrameAllocator::deallocate(ptr, size);
+        }
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        FinalAwaiter final_suspend() noexcept { return {}; }
+
+        void unhandled_exception() noexcept
+        {
+            exception = std::current_exception();
+        }
+
+        // An awaited sender completed with done, the frame stays suspended until the op goes away
+        void unhandled_done() noexcept
+        {
+            op->done();
+        }
+
+        OpBase* op{nullptr};
+        std::exception_ptr exception;
+        // Fed by the stop token of the op's receiver
+        unifex::inplace_stop_source stop_source;
+    };
+
+    template<class Sender, class Promise>
+    struct SenderAwaiter
+    {
+        using Value = awaited_value_t<Sender>;
+        using StoredValue = std::conditional_t<std::is_void_v<Value>, std::monostate, Value>;
+
+        struct Receiver
+        {
+            template<class... Values>
+            void set_value(Values&&... values) && noexcept
+            {
+                try
+                {
+                    awaiter->value.emplace(std::forward<Values>(values)...);
+                }
+                catch (...)
+                {
+                    awaiter->exception = std::current_exception();
+                }
+                awaiter->coro.resume();
+            }
+
+            template<class Error>
+            void set_error(Error&& error) && noexcept
+            {
+                if constexpr (std::is_same_v<std::remove_cvref_t<Error>, std::exception_ptr>)
+                {
+                    awaiter->exception = std::forward<Error>(error);
+                }
+                else
+                {
+                    awaiter->exception = std::make_exception_ptr(std::forward<Error>(error));
+                }
+                awaiter->coro.resume();
+            }
+
+            void set_done() && noexcept
+            {
+                awaiter->coro.promise().unhandled_done();
+            }
+
+            friend unifex::inplace_stop_token tag_invoke(unifex::tag_t<unifex::get_stop_token>,
+                const Receiver& receiver) noexcept
+            {
+                return receiver.awaiter->coro.promise().stop_source.get_token();
+            }
+
+            SenderAwaiter* awaiter;
+        };
+
+        SenderAwaiter(Sender&& sender, std::coroutine_handle<Promise> c)
+            : coro{c}
+            , op{unifex::connect(std::forward<Sender>(sender), Receiver{this})}
+        {
+        }
+
+        bool await_ready() const noexcept { return false; }
+
+        // The sender might complete and resume us before start returns
+        void await_suspend(std::coroutine_handle<>) noexcept
+        {
+            unifex::start(op);
+        }
+
+        Value await_resume()
+        {
+            if (exception)
+            {
+                std::rethrow_exception(std::move(exception));
+            }
+
+            if constexpr (!std::is_void_v<Value>)
+            {
+                return std::move(*value);
+            }
+        }
+
+        std::coroutine_handle<Promise> coro;
+        std::optional<StoredValue> value;
+        std::exception_ptr exception;
+        unifex::connect_result_t<Sender, Receiver> op;
+    };
+
+    template<class T>
+    struct PooledTaskResult
+    {
+        template<class U = T>
+        void return_value(U&& result)
+        {
+            value.emplace(std::forward<U>(result));
+        }
+
+        std::optional<T> value;
+    };
+
+    template<>
+    struct PooledTaskResult<void>
+    {
+        void return_void() noexcept {}
+    };
+
+    template<class T>
+    struct PooledTaskValueTypes
+    {
+        template <
+            template <typename...> class Variant,
+            template <typename...> class Tuple>
+        using type = Variant<Tuple<T>>;
+    };
+
+    template<>
+    struct PooledTaskValueTypes<void>
+    {
+        template <
+            template <typename...> class Variant,
+            template <typename...> class Tuple>
+        using type = Variant<Tuple<>>;
+    };
+
+    template<class T, class Receiver>
+    struct PooledTaskOp : PooledTaskPromiseBase::OpBase
+    {
+        using Handle = std::coroutine_handle<typename PooledTask<T>::promise_type>;
+
+        using StopToken = unifex::stop_token_type_t<Receiver>;
+        static constexpr bool CANCELLABLE = !unifex::is_stop_never_possible_v<StopToken>;
+
+        struct StopCallback
+        {
+            void operator()() noexcept
+            {
+                op->coro.promise().stop_source.request_stop();
+            }
+
+            PooledTaskOp* op;
+        };
+
+        struct NoStopCallback {};
+
+        using StopCallbackStorage = std::conditional_t<CANCELLABLE,
+            std::optional<typename StopToken::template callback_type<StopCallback>>, NoStopCallback>;
+
+        PooledTaskOp(Handle c, auto&& rec)
+            : OpBase(this)
+            , coro{c}
+            , receiver{std::forward<decltype(rec)>(rec)}
+        {
+        }
+
+        PooledTaskOp(const PooledTaskOp&) = delete;
+        PooledTaskOp& operator=(const PooledTaskOp&) = delete;
+
+        ~PooledTaskOp()
+        {
+            coro.destroy();
+        }
+
+        void start() noexcept
+        {
+            coro.promise().op = this;
+
+            if constexpr (CANCELLABLE)
+            {
+                auto token = unifex::get_stop_token(receiver);
+                if (token.stop_possible())
+                {
+                    stop_callback.emplace(token, StopCallback{this});
+                }
+            }
+
+            coro.resume();
+        }
+
+        void complete()
+        {
+            reset_stop_callback();
+
+            auto& promise = coro.promise();
+            if (promise.exception)
+            {
+                unifex::set_error(std::move(receiver), std::move(promise.exception));
+            }
+            else if constexpr (std::is_void_v<T>)
+            {
+                unifex::set_value(std::move(receiver));
+            }
+            else
+            {
+                unifex::set_value(std::move(receiver), std::move(*promise.value));
+            }
+        }
+
+        void done()
+        {
+            reset_stop_callback();
+            unifex::set_done(std::move(receiver));
+        }
+
+        void reset_stop_callback()
+        {
+            if constexpr (CANCELLABLE)
+            {
+                stop_callback.reset();
+            }
+        }
+
+        Handle coro;
+        Receiver receiver;
+        [[no_unique_address]] StopCallbackStorage stop_callback;
+    };
+}
+
+template<class T>
+class PooledTask
+{
+public:
+    struct promise_type : detail::PooledTaskPromiseBase, detail::PooledTaskResult<T>
+    {
+        PooledTask get_return_object() noexcept
+        {
+            return PooledTask{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+
+        template<class Sender>
+            requires unifex::sender<std::remove_cvref_t<Sender>>
+        auto await_transform(Sender&& sender)
+        {
+            return detail::SenderAwaiter<Sender, promise_type>{std::forward<Sender>(sender),
+                std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+    };
+
+    template <
+        template <typename...> class Variant,
+        template <typename...> class Tuple>
+    using value_types = typename detail::PooledTaskValueTypes<T>::template type<Variant, Tuple>;
+
+    template <template <typename...> class Variant>
+    using error_types = Variant<std::exception_ptr>;
+
+    static constexpr bool sends_done = true;
+
+    PooledTask(PooledTask&& other) noexcept
+        : coro_{std::exchange(other.coro_, {})}
+    {
+    }
+
+    PooledTask& operator=(PooledTask&& other) noexcept
+    {
+        PooledTask{std::move(other)}.swap(*this);
+        return *this;
+    }
+
+    ~PooledTask()
+    {
+        if (coro_)
+        {
+            coro_.destroy();
+        }
+    }
+
+    // The op takes over the frame, the task is left empty
+    template<class Receiver>
+    auto connect(Receiver&& receiver) &&
+    {
+        return detail::PooledTaskOp<T, std::remove_cvref_t<Receiver>>{
+            std::exchange(coro_, {}), std::forward<Receiver>(receiver)};
+    }
+
+private:
+    explicit PooledTask(std::coroutine_handle<promise_type> coro) noexcept
+        : coro_{coro}
+    {
+    }
+
+    void swap(PooledTask& other) noexcept
+    {
+        std::swap(coro_, other.coro_);
+    }
+
+private:
+    std::coroutine_handle<promise_type> coro_;
+};
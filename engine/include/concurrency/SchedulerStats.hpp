@@ -0,0 +1,202 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "concurrency/CachelinePad.hpp"
+#include "concurrency/LockStats.hpp"
+
+
+// Bucket i counts durations in [2^(i-1), 2^i) nanoseconds, the last one catches the rest
+struct LatencyHistogram
+{
+    static constexpr std::size_t BUCKET_COUNT = 32;
+
+    std::array<std::uint64_t, BUCKET_COUNT> buckets{};
+
+    static std::size_t bucket_for(std::chrono::nanoseconds duration)
+    {
+        auto ns = static_cast<std::uint64_t>(std::max<std::int64_t>(duration.count(), 0));
+        return std::min<std::size_t>(std::bit_width(ns), BUCKET_COUNT - 1);
+    }
+
+    std::uint64_t count() const
+    {
+        std::uint64_t result = 0;
+        for (auto bucket : buckets)
+        {
+            result += bucket;
+        }
+        return result;
+    }
+
+    // Upper bound of the bucket containing the given fraction of the samples
+    std::chrono::nanoseconds percentile(double fraction) const
+    {
+        auto total = count();
+        if (total == 0)
+        {
+            return std::chrono::nanoseconds{0};
+        }
+
+        auto needed = static_cast<std::uint64_t>(fraction * static_cast<double>(total));
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < BUCKET_COUNT; ++i)
+        {
+            seen += buckets[i];
+            if (seen > needed || seen == total)
+            {
+                return std::chrono::nanoseconds{std::int64_t{1} << i};
+            }
+        }
+        return std::chrono::nanoseconds{std::int64_t{1} << (BUCKET_COUNT - 1)};
+    }
+
+    LatencyHistogram& operator+=(const LatencyHistogram& other)
+    {
+        for (std::size_t i = 0; i < BUCKET_COUNT; ++i)
+        {
+            buckets[i] += other.buckets[i];
+        }
+        return *this;
+    }
+
+    LatencyHistogram& operator-=(const LatencyHistogram& other)
+    {
+        for (std::size_t i = 0; i < BUCKET_COUNT; ++i)
+        {
+            buckets[i] -= other.buckets[i];
+        }
+        return *this;
+    }
+};
+
+// A snapshot of a single worker's counters. Counters only grow,
+// so the difference of two snapshots describes the time between them.
+struct WorkerStats
+{
+    std::uint64_t tasks_run{0};
+    // Out of tasks_run: taken from another worker's deque
+    std::uint64_t tasks_stolen{0};
+    // Out of tasks_run: submitted to this worker specifically
+    std::uint64_t pinned_tasks{0};
+    std::uint64_t parks{0};
+    std::chrono::nanoseconds parked_time{0};
+    // From enqueueing a task to it starting
+    LatencyHistogram wake_latency;
+
+    std::uint64_t unpinned_tasks() const { return tasks_run - pinned_tasks; }
+
+    WorkerStats& operator+=(const WorkerStats& other)
+    {
+        tasks_run += other.tasks_run;
+        tasks_stolen += other.tasks_stolen;
+        pinned_tasks += other.pinned_tasks;
+        parks += other.parks;
+        parked_time += other.parked_time;
+        wake_latency += other.wake_latency;
+        return *this;
+    }
+
+    WorkerStats& operator-=(const WorkerStats& other)
+    {
+        tasks_run -= other.tasks_run;
+        tasks_stolen -= other.tasks_stolen;
+        pinned_tasks -= other.pinned_tasks;
+        parks -= other.parks;
+        parked_time -= other.parked_time;
+        wake_latency -= other.wake_latency;
+        return *this;
+    }
+};
+
+struct PoolStats
+{
+    std::vector<WorkerStats> workers;
+    // Approximate, tasks waiting to be picked up right now
+    std::size_t queued_tasks{0};
+    // Locks guarding the pool's shared queues, if there are any
+    LockStats queue_locks;
+
+    WorkerStats total() const
+    {
+        WorkerStats result;
+        for (auto& worker : workers)
+        {
+            result += worker;
+        }
+        return result;
+    }
+};
+
+// Live counters of a worker. Only the owning worker writes them,
+// so they are bumped without read-modify-write instructions,
+// anyone can take a snapshot at any time.
+class alignas(CACHELINE_SIZE) WorkerCounters
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    void task_started(Clock::time_point enqueued_at, bool pinned)
+    {
+        bump(tasks_run_);
+        if (pinned) { bump(pinned_tasks_); }
+        bump(wake_latency_[LatencyHistogram::bucket_for(Clock::now() - enqueued_at)]);
+    }
+
+    void task_stolen()
+    {
+        bump(tasks_stolen_);
+    }
+
+    void parked(std::chrono::nanoseconds duration)
+    {
+        bump(parks_);
+        bump(parked_ns_, static_cast<std::uint64_t>(duration.count()));
+    }
+
+    WorkerStats snapshot() const
+    {
+        WorkerStats result;
+        result.tasks_run = tasks_run_.load(std::memory_order::relaxed);
+        result.tasks_stolen = tasks_stolen_.load(std::memory_order::relaxed);
+        result.pinned_tasks = pinned_tasks_.load(std::memory_order::relaxed);
+        result.parks = parks_.load(std::memory_order::relaxed);
+        result.parked_time = std::chrono::nanoseconds{
+            static_cast<std::int64_t>(parked_ns_.load(std::memory_order::relaxed))};
+        for (std::size_t i = 0; i < LatencyHistogram::BUCKET_COUNT; ++i)
+        {
+            result.wake_latency.buckets[i] = wake_latency_[i].load(std::memory_order::relaxed);
+        }
+        return result;
+    }
+
+private:
+    static void bump(std::atomic<std::uint64_t>& counter, std::uint64_t by = 1)
+    {
+        counter.store(counter.load(std::memory_order::relaxed) + by, std::memory_order::relaxed);
+    }
+
+private:
+    std::atomic<std::uint64_t> tasks_run_{0};
+    std::atomic<std::uint64_t> tasks_stolen_{0};
+    std::atomic<std::uint64_t> pinned_tasks_{0};
+    std::atomic<std::uint64_t> parks_{0};
+    std::atomic<std::uint64_t> parked_ns_{0};
+    std::array<std::atomic<std::uint64_t>, LatencyHistogram::BUCKET_COUNT> wake_latency_{};
+};
+
+// Filled in by the single thread draining an event queue
+struct EventQueueStats
+{
+    std::uint64_t serial_events{0};
+    std::uint64_t concurrent_events{0};
+    // Sizes of the latest drains
+    std::size_t last_serial_batch{0};
+    std::size_t last_concurrent_batch{0};
+};
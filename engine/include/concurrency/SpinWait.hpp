@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstddef>
+#include <thread>
+
 #include "util/TargetInfo.hpp"
 
 
@@ -1,21 +1,29 @@
 #pragma once
 
 #include <array>
+#include <atomic>
+#include <bit>
+#include <optional>
 #include <type_traits>
+#include <spdlog/spdlog.h>
 #include <unifex/sender_concepts.hpp>
 
 
 #include "util/Assert.hpp"
-#include "concurrency/Spinlock.hpp"
+#include "concurrency/AdaptiveMutex.hpp"
+#include "concurrency/AtomicUIntTuple.hpp"
 #include "concurrency/OpParkingLot.hpp"
 
 
+// Runs at most `capacity` senders at a time, spawning more waits for a free slot.
+// Values sent by the spawned senders are discarded, errors are fatal.
+// Spawns and completions only take the lock when somebody is parked.
 template<std::size_t N, unifex::sender Sender>
 class StaticScope
 {
     struct DoneReceiver
     {
-        void set_value() &&
+        void set_value(auto&&...) &&
         {
             std::move(*this).set_done();
         }
@@ -34,7 +42,7 @@ class StaticScope
                 }
                 catch(...)
                 {
-                    spdlog::error("Something different from an exception got thrown in the rendering scope!");
+                    spdlog::error("Something different from an exception got thrown in a static scope!");
                 }
             }
             std::terminate();
@@ -166,13 +174,13 @@ class StaticScope
     };
 public:
     StaticScope(std::size_t size) noexcept
-        : size_{0}
+        : state_{{0, 0, 0, 0}}
         , capacity_{size}
     {
         NG_ASSERT(size <= N);
         for (std::size_t i = 0; i < storage_.size(); ++i)
         {
-            storage_[i].next_free = i+1;
+            storage_[i].next_free.store(i + 1, std::memory_order::relaxed);
         }
     }
 
@@ -188,63 +196,153 @@ public:
     }
     
 private:
-    void free_slot(std::size_t slot)
+    // Free slot stack head, size, whether anyone is parked and an ABA tag
+    static constexpr std::size_t INDEX_BITS = std::bit_width(N);
+    static constexpr std::size_t TAG_BITS = 64 - 2 * INDEX_BITS - 1;
+    static_assert(TAG_BITS >= 16, "Too many slots to pack the state into 64 bits");
+    using State = AtomicUIntTuple<INDEX_BITS, INDEX_BITS, 1, TAG_BITS>;
+    enum : std::size_t { FIRST_FREE, SIZE, PARKED, TAG };
+
+    using StateValue = typename State::ValueType;
+
+    // CASes the state with update for as long as it satisfies pred.
+    // Returns the state before the update, or nothing if pred failed.
+    std::optional<StateValue> update_state_if(auto pred, auto update)
     {
-        // clear op preemptively to free resources
-        storage_[slot].op.destruct();
-        storage_[slot].next_free = first_free_slot_;
-        first_free_slot_ = slot;
-        --size_;
+        auto state = state_.load(std::memory_order::acquire);
+        while (pred(state))
+        {
+            auto desired = state;
+            update(desired);
+            if (state_.template compare_exchange<true>(state, desired,
+                std::memory_order::acq_rel, std::memory_order::acquire))
+            {
+                return state;
+            }
+        }
+        return std::nullopt;
     }
 
-    void on_done(std::size_t slot) noexcept
+    // Fails when the scope is full. Unless ignore_parked is set, also fails
+    // when somebody is parked, so that parked spawns don't get overtaken.
+    std::optional<std::size_t> try_take_slot(bool ignore_parked)
     {
-        std::unique_lock lock{spinlock_};
-
-        // Try and wake someone straight into this slot. If unsuccessful,
-        // free the slot
-        if (!awaiting_spawn_.wake_one(lock, slot))
+        auto old = update_state_if(
+            [this, ignore_parked](const StateValue& state)
+            {
+                return state[SIZE] < capacity_ && (ignore_parked || state[PARKED] == 0);
+            },
+            [this](StateValue& state)
+            {
+                // Might read a stale value if the slot got taken concurrently,
+                // but the tag will make the CAS fail in that case
+                state[FIRST_FREE] = storage_[state[FIRST_FREE]].next_free.load(std::memory_order::relaxed);
+                ++state[SIZE];
+                ++state[TAG];
+            });
+
+        if (!old.has_value())
         {
-            free_slot(slot);
-            
-            if (size_ == 0)
+            return std::nullopt;
+        }
+        return (*old)[FIRST_FREE];
+    }
+
+    // Returns the new size. Unless locked, fails when somebody is parked,
+    // as they have to be woken up by whoever frees the slot.
+    std::optional<std::size_t> try_free_slot(std::size_t slot, bool locked)
+    {
+        auto old = update_state_if(
+            [locked](const StateValue& state)
             {
-                awaiting_all_finished_.wake_all(lock);
-            }
+                return locked || state[PARKED] == 0;
+            },
+            [this, slot, locked](StateValue& state)
+            {
+                storage_[slot].next_free.store(state[FIRST_FREE], std::memory_order::relaxed);
+                state[FIRST_FREE] = slot;
+                --state[SIZE];
+                ++state[TAG];
+                if (locked)
+                {
+                    // Everyone waiting for all to finish gets woken up when the size hits 0
+                    state[PARKED] = state[SIZE] > 0 && !awaiting_all_finished_.empty();
+                }
+            });
+
+        if (!old.has_value())
+        {
+            return std::nullopt;
         }
+        return (*old)[SIZE] - 1;
     }
 
-    std::size_t take_slot()
+    // Should be called under the lock, right before parking
+    bool try_mark_parked(auto pred)
     {
-        ++size_;
-        auto slot = first_free_slot_;
-        first_free_slot_ = storage_[slot].next_free;
-        return slot;
+        return update_state_if(pred, [](StateValue& state) { state[PARKED] = 1; }).has_value();
     }
 
-    void do_spawn(SpawnOpBase* op)
+    void on_done(std::size_t slot) noexcept
     {
-        std::unique_lock lock{spinlock_};
+        // clear op preemptively to free resources
+        storage_[slot].op.destruct();
+
+        if (try_free_slot(slot, false).has_value())
+        {
+            return;
+        }
+
+        std::unique_lock lock{mutex_};
 
-        if (size_ < capacity_)
+        // Try and wake someone straight into this slot. If unsuccessful,
+        // free the slot
+        if (awaiting_spawn_.wake_one(lock, slot))
         {
-            auto slot = take_slot();
-            lock.unlock();
+            return;
+        }
 
-            // Unlocking before waking is important!
-            // Wake starts another operation that might use this static scope again and deadlock
-            op->wake(slot);
+        if (*try_free_slot(slot, true) == 0)
+        {
+            awaiting_all_finished_.wake_all(lock);
+        }
+    }
 
+    void do_spawn(SpawnOpBase* op)
+    {
+        if (auto slot = try_take_slot(false))
+        {
+            op->wake(*slot);
             return;
         }
 
-        awaiting_spawn_.park(op);
+        std::unique_lock lock{mutex_};
+
+        // A slot might get freed between taking the lock and marking ourselves
+        // as parked, after that frees have to take the lock and will see us
+        while (true)
+        {
+            if (auto slot = try_take_slot(true))
+            {
+                // Unlocking before waking is important!
+                // Wake starts another operation that might use this static scope again and deadlock
+                lock.unlock();
+                op->wake(*slot);
+                return;
+            }
+
+            if (try_mark_parked([this](const StateValue& state) { return state[SIZE] >= capacity_; }))
+            {
+                awaiting_spawn_.park(op);
+                return;
+            }
+        }
     }
 
     void do_wait_all_done(AllFinishedOpBase* op)
     {
-        std::unique_lock guard{spinlock_};
-        if (size_ > 0)
+        std::unique_lock guard{mutex_};
+        if (try_mark_parked([](const StateValue& state) { return state[SIZE] > 0; }))
         {
             awaiting_all_finished_.park(op);
             return;
@@ -259,20 +357,20 @@ private:
     struct Slot
     {
         unifex::manual_lifetime<unifex::connect_result_t<Sender, DoneReceiver>> op;
-        std::size_t next_free;
+        // Only atomic because a racing take might read it, see try_take_slot
+        std::atomic<std::size_t> next_free;
     };
 
     // Storage is actually a stack of slots (the +1 is for the sentinel)
-    // first_free_slot_ is the head, size_ is the size, duh
     std::array<Slot, N + 1> storage_;
-    std::size_t first_free_slot_{0};
-    std::size_t size_;
+    State state_;
     std::size_t capacity_;
     
     SpawnLot awaiting_spawn_;
     AllFinishedLot awaiting_all_finished_;
     
-    // Guards everything. Do be careful with this one, as the logic behind unlocking and
+    // Guards the lots and setting the parked flag. Frees have to take it while the
+    // flag is set, so do be careful with this one, as the logic behind unlocking and
     // starting new ops is tricky
-    Spinlock spinlock_;
+    AdaptiveMutex mutex_;
 };
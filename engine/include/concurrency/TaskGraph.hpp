@@ -0,0 +1,132 @@
+#pragma once
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "unifex/receiver_concepts.hpp"
+
+#include "concurrency/PooledTask.hpp"
+#include "concurrency/ThreadPool.hpp"
+#include "util/Mixins.hpp"
+
+
+// A DAG of jobs that is built once and then run as many times as needed,
+// e.g. once per frame. A node gets scheduled on the pool as soon as the last
+// of its dependencies finishes, so independent nodes overlap without any
+// hand-written synchronization. Dependencies have to be added before the nodes
+// depending on them, which rules out cycles.
+// Only a single run may be in progress at a time.
+class TaskGraph : public NoMove
+{
+    struct Node;
+
+    template<class Receiver>
+    struct Op
+    {
+        Op(TaskGraph& g, auto&& rec)
+            : graph{g}
+            , receiver{std::forward<decltype(rec)>(rec)}
+        {
+        }
+
+        Op(const Op&) = delete;
+        Op& operator=(const Op&) = delete;
+
+        void start() noexcept
+        {
+            graph.begin_run(this, +[](void* self, std::exception_ptr error)
+                {
+                    auto& op = *static_cast<Op*>(self);
+                    if (error)
+                    {
+                        unifex::set_error(std::move(op.receiver), std::move(error));
+                    }
+                    else
+                    {
+                        unifex::set_value(std::move(op.receiver));
+                    }
+                });
+        }
+
+        TaskGraph& graph;
+        Receiver receiver;
+    };
+
+public:
+    using NodeId = std::size_t;
+
+    struct Sender
+    {
+        template <
+            template <typename...> class Variant,
+            template <typename...> class Tuple>
+        using value_types = Variant<Tuple<>>;
+
+        template <template <typename...> class Variant>
+        using error_types = Variant<std::exception_ptr>;
+
+        static constexpr bool sends_done = false;
+
+        template<class Receiver>
+        auto connect(Receiver&& r)
+        {
+            return Op<std::remove_cvref_t<Receiver>>{*graph, std::forward<Receiver>(r)};
+        }
+
+        TaskGraph* graph;
+    };
+
+    explicit TaskGraph(ThreadPool::Scheduler scheduler);
+    ~TaskGraph() noexcept;
+
+    // name has to outlive the graph, it shows up in traces
+    NodeId add(const char* name, std::function<void()> work);
+
+    // For work that has to happen on a specific pool thread, e.g. talking to the OS
+    NodeId add_pinned(const char* name, std::size_t thread, std::function<void()> work);
+
+    // The node finishes once the returned task does
+    NodeId add_async(const char* name, std::function<PooledTask<void>()> task);
+
+    void depends_on(NodeId node, NodeId dependency);
+
+    // Completes once every node has finished. The first exception is propagated,
+    // the nodes that haven't started by then are skipped.
+    Sender run()
+    {
+        return Sender{this};
+    }
+
+    std::size_t size() const
+    {
+        return nodes_.size();
+    }
+
+private:
+    using CompleteFunc = void (*)(void*, std::exception_ptr);
+
+    NodeId add_node(std::unique_ptr<Node> node);
+
+    void begin_run(void* op, CompleteFunc complete) noexcept;
+    void launch(Node& node) noexcept;
+    void execute(Node& node) noexcept;
+    void node_finished(Node& node) noexcept;
+    void fail(std::exception_ptr error) noexcept;
+    void release_run() noexcept;
+
+private:
+    ThreadPool::Scheduler scheduler_;
+    std::vector<std::unique_ptr<Node>> nodes_;
+    std::vector<NodeId> roots_;
+
+    // Per run state
+    std::atomic<std::size_t> remaining_{0};
+    std::atomic<bool> failed_{false};
+    std::exception_ptr error_;
+    void* run_op_{nullptr};
+    CompleteFunc complete_{nullptr};
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+
+// Sorted list of logical CPU indices. Empty means "anywhere".
+using CpuSet = std::vector<std::size_t>;
+
+// CPUs this process is allowed to run on
+CpuSet process_cpus();
+
+struct NumaNode
+{
+    // The OS's node number, which doesn't have to match the position in numa_nodes()
+    std::size_t id;
+    CpuSet cpus;
+};
+
+// Every NUMA node that has CPUs, sorted by id.
+// A single node 0 containing everything if NUMA info is not available.
+std::vector<NumaNode> numa_nodes();
+
+// Returns false if the OS refused or pinning is not supported
+bool set_current_thread_affinity(const CpuSet& cpus);
+
+CpuSet cpu_set_intersection(const CpuSet& a, const CpuSet& b);
+
+CpuSet cpu_set_difference(const CpuSet& a, const CpuSet& b);
@@ -1,13 +1,36 @@
 #pragma once
 
-#include <condition_variable>
-
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "unifex/get_stop_token.hpp"
 #include "unifex/receiver_concepts.hpp"
 #include "unifex/schedule_with_subscheduler.hpp"
+#include "unifex/stop_token_concepts.hpp"
 
+#include "concurrency/LockfreeQueue.hpp"
 #include "concurrency/OpParkingLot.hpp"
-#include "concurrency/Spinlock.hpp"
+#include "concurrency/SchedulerStats.hpp"
+#include "concurrency/TicketLock.hpp"
+#include "concurrency/ThreadAffinity.hpp"
+#include "concurrency/WorkStealingDeque.hpp"
+#include "util/Trace.hpp"
+
+
+enum class TaskPriority
+{
+    // Work the current frame is waiting on
+    Critical,
+    Normal,
+    // Streaming and other work that can be late, its concurrency is capped
+    Background,
+};
 
+constexpr std::size_t TASK_PRIORITY_COUNT = 3;
 
 // General purpose thread pool with subscheduler capabilities
 class ThreadPool
@@ -18,24 +41,54 @@ class ThreadPool
 
     using OpBase = ToStartLot::OpBase;
 
+    using Clock = WorkerCounters::Clock;
+
     template<class Receiver>
     struct Op : OpBase
     {
-        Op(ThreadPool& p, auto&& rec, std::size_t tid)
+        Op(ThreadPool& p, auto&& rec, std::size_t tid, TaskPriority prio)
             : OpBase(this)
             , pool{p}
             , receiver{std::forward<decltype(rec)>(rec)}
             , requested_thread{tid}
+            , priority{prio}
         {
         }
 
         void start() noexcept
         {
-            pool.enqueue(this, requested_thread);
+            if constexpr (!unifex::is_stop_never_possible_v<unifex::stop_token_type_t<Receiver>>)
+            {
+                if (unifex::get_stop_token(receiver).stop_requested())
+                {
+                    unifex::set_done(std::move(receiver));
+                    return;
+                }
+            }
+
+            enqueued_at = Clock::now();
+            flow.start("ThreadPool hop");
+            pool.enqueue(this, requested_thread, priority);
         }
         
         void wake()
         {
+            // Covers whatever the continuation runs until it suspends again
+            NG_TRACE_ZONE("ThreadPool task");
+            flow.finish("ThreadPool hop");
+            pool.task_started(enqueued_at, requested_thread != THREAD_NONE);
+
+            // Ops can't be unlinked from the deques, so cancelled ones are
+            // only skipped once a worker gets to them
+            if constexpr (!unifex::is_stop_never_possible_v<unifex::stop_token_type_t<Receiver>>)
+            {
+                if (unifex::get_stop_token(receiver).stop_requested())
+                {
+                    unifex::set_done(std::move(receiver));
+                    return;
+                }
+            }
+
             unifex::set_value(std::move(receiver));
         }
 
@@ -47,6 +100,9 @@ class ThreadPool
         ThreadPool& pool;
         Receiver receiver;
         std::size_t requested_thread;
+        TaskPriority priority;
+        Clock::time_point enqueued_at;
+        [[no_unique_address]] TraceFlow flow;
     };
 
 public:
@@ -68,24 +124,41 @@ public:
             template<unifex::receiver_of<> Receiver>
             auto connect(Receiver&& r)
             {
-                return Op<std::remove_cvref_t<Receiver>>(*pool, std::forward<Receiver>(r), requested_thread);
+                return Op<std::remove_cvref_t<Receiver>>(*pool, std::forward<Receiver>(r),
+                    requested_thread, priority);
             }
 
             std::size_t requested_thread;
             ThreadPool* pool;
+            TaskPriority priority{TaskPriority::Normal};
         };
         
     public:
-        explicit Scheduler(ThreadPool* pool) : pool_{pool} {}
+        explicit Scheduler(ThreadPool* pool, TaskPriority priority = TaskPriority::Normal)
+            : pool_{pool}
+            , priority_{priority}
+        {
+        }
 
         Sender schedule() const
         {
-            return Sender{THREAD_NONE, pool_};
+            return Sender{THREAD_NONE, pool_, priority_};
         }
 
+        // Pinned work ignores the priority and always goes first
         Sender schedule_with_subscheduler() const
         {
-            return Sender{pool_->this_thread_idx_, pool_};
+            return Sender{pool_->this_thread_idx_, pool_, priority_};
+        }
+
+        Sender schedule_on_thread(std::size_t thread) const
+        {
+            return Sender{thread, pool_, priority_};
+        }
+
+        std::size_t thread_count() const noexcept
+        {
+            return pool_->thread_count();
         }
 
         friend Sender tag_invoke(unifex::tag_t<unifex::schedule_with_subscheduler>, const Scheduler& scheduler)
@@ -97,46 +170,101 @@ public:
 
     private:
         ThreadPool* pool_;
+        TaskPriority priority_;
     };
 
 
-    explicit ThreadPool(std::size_t thread_count = std::thread::hardware_concurrency());
+    // 0 background tasks means half of the threads.
+    // Thread i gets pinned to affinities[i % affinities.size()].
+    explicit ThreadPool(std::size_t thread_count = std::thread::hardware_concurrency(),
+        std::size_t max_background_tasks = 0, std::vector<CpuSet> affinities = {});
+
+    Scheduler get_scheduler(TaskPriority priority = TaskPriority::Normal) noexcept
+    {
+        return Scheduler{this, priority};
+    }
+
+    std::size_t thread_count() const noexcept { return thread_data_.size(); }
 
-    Scheduler get_scheduler() noexcept { return Scheduler{this}; }
+    // Can be called from any thread, the counters of a worker are only
+    // consistent with each other up to the tasks it is running right now
+    PoolStats stats() const;
 
     void request_stop() noexcept;
 
     ~ThreadPool() noexcept;
 
 private:
+    static thread_local ThreadPool* this_thread_pool_;
     static thread_local std::size_t this_thread_idx_;
 
-    void enqueue(OpBase* op, std::size_t requested_thread);
+    void enqueue(OpBase* op, std::size_t requested_thread, TaskPriority priority);
+
+    void task_started(Clock::time_point enqueued_at, bool pinned);
 
     void thread_loop(std::size_t i);
 
-    void run_task();
+    bool run_task();
+
+    bool run_task(TaskPriority priority);
+
+    // Runs a background task if the concurrency limit allows it
+    bool run_background_task();
+
+    bool background_allowed() const;
+
+    // Approximate, used to double check before going to sleep
+    bool has_work(std::size_t tid) const;
+
+    void park(std::size_t tid);
 
-    using LockType = Spinlock;
+    void notify_workers(bool all);
 
-    struct ThreadData
+    // Wakes up a specific worker, but only if it is sleeping
+    void notify_worker(std::size_t tid);
+
+    void wake(std::size_t tid);
+
+    // Every worker polls the injected lanes, so they need a fair lock
+    using LockType = TicketLock;
+
+    struct alignas(CACHELINE_SIZE) ThreadData
     {
-        LockType spinlock;
-        ToStartLot awaiting_start;
-        
-        LockType pinned_spinlock;
-        ToStartLot awaiting_start_pinned;
-        
-        std::condition_variable_any any_awaiting;
+        // Unpinned work spawned from this thread, others steal from here
+        std::array<WorkStealingDeque<OpBase>, TASK_PRIORITY_COUNT> deques;
+
+        // Work that can only be run on this thread, consumed by it exclusively
+        LockfreeQueue<OpBase> awaiting_start_pinned;
+
+        // Sleeping workers wait on this to become non-zero
+        std::atomic<std::uint32_t> wake_token{0};
+
+        WorkerCounters counters;
     };
 
+    static constexpr std::size_t SPIN_ROUNDS = 32;
+    static constexpr std::size_t IDLE_WORD_BITS = 64;
+
 
 
 private:
     std::vector<std::thread> threads_;
     std::vector<ThreadData> thread_data_;
-    std::atomic<std::size_t> current_thread_round_robin_{0};
-    std::atomic<bool> stop_requested_{false};
-};
 
+    // Work submitted from threads that don't belong to this pool
+    struct alignas(CACHELINE_SIZE) InjectedLane
+    {
+        LockType lock;
+        ToStartLot lot;
+        std::atomic<std::size_t> count{0};
+    };
+    std::array<InjectedLane, TASK_PRIORITY_COUNT> injected_;
+
+    std::size_t max_background_tasks_;
+    std::atomic<std::size_t> running_background_tasks_{0};
+
+    // Bit i is set iff worker i is sleeping (or about to)
+    std::vector<std::atomic<std::uint64_t>> idle_workers_;
 
+    std::atomic<bool> stop_requested_{false};
+};
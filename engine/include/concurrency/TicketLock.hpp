@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "concurrency/LockStats.hpp"
+#include "concurrency/SpinWait.hpp"
+
+
+// Fair FIFO lock for heavily contended spots, where AdaptiveMutex could
+// starve some threads. Waiters spin for a bit depending on how far back in
+// line they are and then sleep until their ticket comes up.
+class TicketLock
+{
+public:
+    static constexpr std::size_t SPIN_LIMIT = 64;
+
+    TicketLock() = default;
+    TicketLock(const TicketLock&) = delete;
+    TicketLock& operator=(const TicketLock&) = delete;
+
+    void lock()
+    {
+        auto ticket = next_.fetch_add(1, std::memory_order::relaxed);
+        auto serving = serving_.load(std::memory_order::acquire);
+        if (serving == ticket)
+        {
+            return;
+        }
+
+        counters_.contended();
+
+        // Somebody far back in line won't get the lock soon, no point in spinning
+        if (ticket - serving <= 1)
+        {
+            for (std::size_t i = 0; i < SPIN_LIMIT; ++i)
+            {
+                cpu_pause();
+                if (serving_.load(std::memory_order::acquire) == ticket)
+                {
+                    return;
+                }
+            }
+        }
+
+        counters_.parked();
+
+        // Pairs with unlock: either it sees us waiting or we see the new ticket
+        sleepers_.fetch_add(1, std::memory_order::seq_cst);
+        while ((serving = serving_.load(std::memory_order::seq_cst)) != ticket)
+        {
+            serving_.wait(serving, std::memory_order::acquire);
+        }
+        sleepers_.fetch_sub(1, std::memory_order::relaxed);
+    }
+
+    bool try_lock()
+    {
+        auto serving = serving_.load(std::memory_order::acquire);
+        auto expected = serving;
+        return next_.compare_exchange_strong(expected, serving + 1,
+            std::memory_order::acquire, std::memory_order::relaxed);
+    }
+
+    void unlock()
+    {
+        // Only the holder ever writes this
+        serving_.store(serving_.load(std::memory_order::relaxed) + 1, std::memory_order::seq_cst);
+
+        // Sleepers can't be told apart, so everyone wakes up and checks their ticket
+        if (sleepers_.load(std::memory_order::seq_cst) != 0)
+        {
+            serving_.notify_all();
+        }
+    }
+
+    LockStats stats() const { return counters_.snapshot(); }
+
+private:
+    std::atomic<std::uint32_t> next_{0};
+    std::atomic<std::uint32_t> serving_{0};
+    std::atomic<std::uint32_t> sleepers_{0};
+    LockCounters counters_;
+};
@@ -0,0 +1,344 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+
+#include "unifex/get_stop_token.hpp"
+#include "unifex/receiver_concepts.hpp"
+#include "unifex/scheduler_concepts.hpp"
+#include "unifex/sender_concepts.hpp"
+#include "unifex/stop_token_concepts.hpp"
+
+#include "concurrency/LockfreeQueue.hpp"
+#include "concurrency/OpParkingLot.hpp"
+#include "concurrency/ThreadPool.hpp"
+
+
+// Time scheduler backed by a hierarchical timer wheel with millisecond resolution.
+// The wheel is driven by a dedicated thread, which never runs user code:
+// expired ops are resumed on the thread pool passed to the constructor.
+// Timers whose stop token gets triggered are taken out of the wheel and complete with done.
+class TimerWheel
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using Tick = std::chrono::milliseconds;
+
+    static constexpr std::size_t SLOT_BITS = 6;
+    static constexpr std::size_t SLOT_COUNT = std::size_t{1} << SLOT_BITS;
+    // 64^6 ms is a bit over two years, anything further waits in the overflow list
+    static constexpr std::size_t LEVEL_COUNT = 6;
+    static constexpr std::uint64_t WHEEL_SPAN = std::uint64_t{1} << (SLOT_BITS * LEVEL_COUNT);
+
+private:
+    using OpBase = OpParkingLot<>::OpBase;
+
+    struct TimerOpBase : OpBase
+    {
+        enum State : std::uint8_t
+        {
+            PENDING,
+            FIRED,
+            CANCELLED,
+        };
+
+        static constexpr std::uint8_t NOT_LINKED = 0xFF;
+
+        template<class Derived>
+        TimerOpBase(Derived* derived, Clock::time_point tp)
+            : OpBase(derived)
+            , deadline{tp}
+        {
+        }
+
+        // Firing and the stop callback race for the op, whoever moves it out of PENDING wins
+        bool claim(State to)
+        {
+            auto expected = PENDING;
+            return state.compare_exchange_strong(expected, to, std::memory_order::acq_rel);
+        }
+
+        Clock::time_point deadline;
+        std::atomic<State> state{PENDING};
+
+        // Only touched by the timer thread
+        std::uint64_t deadline_tick{0};
+        // Slot lists are doubly linked, so that cancelled ops can be unlinked in O(1)
+        TimerOpBase* prev{nullptr};
+        // level == LEVEL_COUNT stands for the overflow list
+        std::uint8_t level{NOT_LINKED};
+        std::uint8_t slot{0};
+        // Taken out of incoming_, before that the op isn't ours to complete
+        bool arrived{false};
+
+        // Guarded by the wheel's mutex
+        TimerOpBase* next_cancelled{nullptr};
+    };
+
+    template<class Receiver>
+    struct Op : TimerOpBase
+    {
+        using StopToken = unifex::stop_token_type_t<Receiver>;
+        static constexpr bool CANCELLABLE = !unifex::is_stop_never_possible_v<StopToken>;
+
+        struct StopCallback
+        {
+            void operator()() noexcept
+            {
+                op->wheel.request_cancel(op);
+            }
+
+            Op* op;
+        };
+
+        struct NoStopCallback {};
+
+        using StopCallbackStorage = std::conditional_t<CANCELLABLE,
+            std::optional<typename StopToken::template callback_type<StopCallback>>, NoStopCallback>;
+
+        struct ResumeReceiver
+        {
+            void set_value() && noexcept
+            {
+                op->complete();
+            }
+
+            void set_done() && noexcept
+            {
+                op->reset_stop_callback();
+                unifex::set_done(std::move(op->receiver));
+            }
+
+            void set_error(std::exception_ptr e) && noexcept
+            {
+                op->reset_stop_callback();
+                unifex::set_error(std::move(op->receiver), std::move(e));
+            }
+
+            Op* op;
+        };
+
+        Op(TimerWheel& w, auto&& rec, Clock::time_point tp)
+            : TimerOpBase(this, tp)
+            , wheel{w}
+            , receiver{std::forward<decltype(rec)>(rec)}
+            , resume{unifex::connect(w.resume_scheduler_.schedule(), ResumeReceiver{this})}
+        {
+        }
+
+        void start() noexcept
+        {
+            if constexpr (CANCELLABLE)
+            {
+                auto token = unifex::get_stop_token(receiver);
+                if (token.stop_requested())
+                {
+                    unifex::set_done(std::move(receiver));
+                    return;
+                }
+
+                // Has to be in place before the timer thread can see the op.
+                // If it fires before that, the timer thread waits for the op to show up.
+                if (token.stop_possible())
+                {
+                    stop_callback.emplace(token, StopCallback{this});
+                }
+            }
+
+            wheel.enqueue(this);
+        }
+
+        // Called from the timer thread, both for fired and cancelled ops, so just hop to the pool
+        void wake()
+        {
+            unifex::start(resume);
+        }
+
+        // Called from the timer thread when it shuts down
+        void cancel()
+        {
+            reset_stop_callback();
+            unifex::set_done(std::move(receiver));
+        }
+
+        void complete()
+        {
+            // Waits for a concurrently running callback, which lost the race or has already handed us over
+            reset_stop_callback();
+            if (this->state.load(std::memory_order::acquire) == TimerOpBase::CANCELLED)
+            {
+                unifex::set_done(std::move(receiver));
+                return;
+            }
+
+            unifex::set_value(std::move(receiver));
+        }
+
+        void reset_stop_callback()
+        {
+            if constexpr (CANCELLABLE)
+            {
+                stop_callback.reset();
+            }
+        }
+
+        TimerWheel& wheel;
+        Receiver receiver;
+        unifex::connect_result_t<ThreadPool::Scheduler::Sender, ResumeReceiver> resume;
+        [[no_unique_address]] StopCallbackStorage stop_callback;
+    };
+
+public:
+    class Scheduler
+    {
+    public:
+        struct Sender
+        {
+            template <
+                template <typename...> class Variant,
+                template <typename...> class Tuple>
+            using value_types = Variant<Tuple<>>;
+
+            template <template <typename...> class Variant>
+            using error_types = Variant<>;
+
+            static constexpr bool sends_done = true;
+
+            template<unifex::receiver_of<> Receiver>
+            auto connect(Receiver&& r)
+            {
+                return Op<std::remove_cvref_t<Receiver>>(*wheel, std::forward<Receiver>(r), deadline);
+            }
+
+            TimerWheel* wheel;
+            Clock::time_point deadline;
+        };
+
+    public:
+        explicit Scheduler(TimerWheel* wheel) : wheel_{wheel} {}
+
+        Clock::time_point now() const
+        {
+            return Clock::now();
+        }
+
+        Sender schedule() const
+        {
+            return Sender{wheel_, Clock::now()};
+        }
+
+        Sender schedule_at(Clock::time_point tp) const
+        {
+            return Sender{wheel_, tp};
+        }
+
+        template<class Rep, class Period>
+        Sender schedule_after(std::chrono::duration<Rep, Period> delay) const
+        {
+            return Sender{wheel_, Clock::now() + std::chrono::duration_cast<Clock::duration>(delay)};
+        }
+
+        friend Clock::time_point tag_invoke(unifex::tag_t<unifex::now>, const Scheduler& scheduler)
+        {
+            return scheduler.now();
+        }
+
+        friend Sender tag_invoke(unifex::tag_t<unifex::schedule_at>, const Scheduler& scheduler,
+            Clock::time_point tp)
+        {
+            return scheduler.schedule_at(tp);
+        }
+
+        template<class Rep, class Period>
+        friend Sender tag_invoke(unifex::tag_t<unifex::schedule_after>, const Scheduler& scheduler,
+            std::chrono::duration<Rep, Period> delay)
+        {
+            return scheduler.schedule_after(delay);
+        }
+
+        friend bool operator==(const Scheduler& a, const Scheduler& b) = default;
+
+    private:
+        TimerWheel* wheel_;
+    };
+
+
+    // The wheel starts counting at start_tick instead of 0,
+    // which lets tests hit level and overflow boundaries without waiting for them
+    explicit TimerWheel(ThreadPool::Scheduler resume_scheduler, std::uint64_t start_tick = 0);
+
+    Scheduler get_scheduler() noexcept { return Scheduler{this}; }
+
+    // Pending timers get cancelled
+    void request_stop() noexcept;
+
+    ~TimerWheel() noexcept;
+
+private:
+    static constexpr std::uint64_t NO_TICK = ~std::uint64_t{0};
+
+    struct Level
+    {
+        std::uint64_t occupied{0};
+        std::array<TimerOpBase*, SLOT_COUNT> slots{};
+    };
+
+    void enqueue(TimerOpBase* op);
+
+    // Called from the stop callback, on any thread
+    void request_cancel(TimerOpBase* op);
+
+    void thread_loop();
+
+    void drain_incoming();
+
+    // Completes the ops whose stop callback fired, returns whether there were any
+    bool process_cancelled(bool complete_inline);
+
+    void insert(TimerOpBase* op);
+
+    void unlink(TimerOpBase* op);
+
+    // Fires everything up to now_tick, returns the tick of the next non-empty slot
+    std::uint64_t advance(std::uint64_t now_tick);
+
+    // level == LEVEL_COUNT stands for the overflow list
+    std::uint64_t next_slot_tick(std::size_t& level, std::size_t& slot) const;
+
+    std::uint64_t to_tick(Clock::time_point tp, bool round_up) const;
+
+    Clock::time_point to_time_point(std::uint64_t tick) const;
+
+    void cancel_all();
+
+private:
+    ThreadPool::Scheduler resume_scheduler_;
+    Clock::time_point epoch_;
+
+    // New timers from any thread, consumed by the timer thread
+    LockfreeQueue<OpBase> incoming_;
+    // Tick the timer thread is going to wake up at,
+    // new timers that expire earlier have to wake it up
+    std::atomic<std::uint64_t> planned_wakeup_tick_{0};
+
+    std::mutex mtx_;
+    std::condition_variable wakeup_;
+    std::atomic<bool> stop_requested_{false};
+    // Linked through next_cancelled, guarded by mtx_
+    TimerOpBase* cancelled_{nullptr};
+
+    // Only touched by the timer thread
+    std::uint64_t current_tick_{0};
+    std::array<Level, LEVEL_COUNT> levels_;
+    TimerOpBase* overflow_{nullptr};
+
+    std::thread thread_;
+};
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "concurrency/CachelinePad.hpp"
+
+
+// Chase-Lev work stealing deque of pointers, memory orderings are taken from
+// "Correct and Efficient Work-Stealing for Weak Memory Models" (Le et al., 2013).
+// push and pop can only be called by the owning thread and work in a LIFO manner,
+// steal can be called by anyone and takes the oldest element.
+template<class T>
+class WorkStealingDeque
+{
+    class Ring
+    {
+    public:
+        explicit Ring(std::int64_t capacity)
+            : mask_{capacity - 1}
+            , data_{std::make_unique<std::atomic<T*>[]>(static_cast<std::size_t>(capacity))}
+        {
+        }
+
+        std::int64_t capacity() const { return mask_ + 1; }
+
+        T* load(std::int64_t i) const
+        {
+            return data_[static_cast<std::size_t>(i & mask_)].load(std::memory_order::relaxed);
+        }
+
+        void store(std::int64_t i, T* value)
+        {
+            data_[static_cast<std::size_t>(i & mask_)].store(value, std::memory_order::relaxed);
+        }
+
+    private:
+        std::int64_t mask_;
+        std::unique_ptr<std::atomic<T*>[]> data_;
+    };
+
+public:
+    static constexpr std::int64_t INITIAL_CAPACITY = 256;
+
+    WorkStealingDeque()
+    {
+        rings_.emplace_back(std::make_unique<Ring>(INITIAL_CAPACITY));
+        ring_.store(rings_.back().get(), std::memory_order::relaxed);
+    }
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    void push(T* value)
+    {
+        auto bottom = bottom_.load(std::memory_order::relaxed);
+        auto top = top_.load(std::memory_order::acquire);
+        auto ring = ring_.load(std::memory_order::relaxed);
+
+        if (bottom - top > ring->capacity() - 1)
+        {
+            ring = grow(ring, top, bottom);
+        }
+
+        ring->store(bottom, value);
+        std::atomic_thread_fence(std::memory_order::release);
+        bottom_.store(bottom + 1, std::memory_order::relaxed);
+    }
+
+    T* pop()
+    {
+        auto bottom = bottom_.load(std::memory_order::relaxed) - 1;
+        auto ring = ring_.load(std::memory_order::relaxed);
+        bottom_.store(bottom, std::memory_order::relaxed);
+        std::atomic_thread_fence(std::memory_order::seq_cst);
+        auto top = top_.load(std::memory_order::relaxed);
+
+        if (top > bottom)
+        {
+            // Empty, restore the bottom
+            bottom_.store(bottom + 1, std::memory_order::relaxed);
+            return nullptr;
+        }
+
+        T* result = ring->load(bottom);
+        if (top == bottom)
+        {
+            // Last element, race against the stealers for it
+            if (!top_.compare_exchange_strong(top, top + 1,
+                std::memory_order::seq_cst, std::memory_order::relaxed))
+            {
+                result = nullptr;
+            }
+            bottom_.store(bottom + 1, std::memory_order::relaxed);
+        }
+
+        return result;
+    }
+
+    // Returns nullptr both when the deque is empty and when the race with
+    // another thief or the owner was lost
+    T* steal()
+    {
+        auto top = top_.load(std::memory_order::acquire);
+        std::atomic_thread_fence(std::memory_order::seq_cst);
+        auto bottom = bottom_.load(std::memory_order::acquire);
+
+        if (top >= bottom)
+        {
+            return nullptr;
+        }
+
+        // Rings are never freed before the deque itself dies, so this is safe
+        // even if the owner is growing the deque right now
+        T* result = ring_.load(std::memory_order::acquire)->load(top);
+        if (!top_.compare_exchange_strong(top, top + 1,
+            std::memory_order::seq_cst, std::memory_order::relaxed))
+        {
+            return nullptr;
+        }
+
+        return result;
+    }
+
+    // Approximate, only useful as a hint
+    bool empty() const
+    {
+        return bottom_.load(std::memory_order::relaxed) <= top_.load(std::memory_order::relaxed);
+    }
+
+    // Approximate, only useful for statistics
+    std::size_t size() const
+    {
+        auto size = bottom_.load(std::memory_order::relaxed) - top_.load(std::memory_order::relaxed);
+        return size > 0 ? static_cast<std::size_t>(size) : 0;
+    }
+
+private:
+    Ring* grow(Ring* old, std::int64_t top, std::int64_t bottom)
+    {
+        auto& fresh = rings_.emplace_back(std::make_unique<Ring>(old->capacity() * 2));
+        for (auto i = top; i < bottom; ++i)
+        {
+            fresh->store(i, old->load(i));
+        }
+        ring_.store(fresh.get(), std::memory_order::release);
+        return fresh.get();
+    }
+
+private:
+    alignas(CACHELINE_SIZE) std::atomic<std::int64_t> top_{0};
+    alignas(CACHELINE_SIZE) std::atomic<std::int64_t> bottom_{0};
+    std::atomic<Ring*> ring_{nullptr};
+    // Old rings are kept alive as thieves might still be reading from them.
+    // Only touched by the owner.
+    std::vector<std::unique_ptr<Ring>> rings_;
+};
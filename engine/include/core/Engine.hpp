@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+
 #include <unifex/task.hpp>
 #include <unifex/async_scope.hpp>
 #include <unifex/manual_event_loop.hpp>
@@ -7,7 +9,16 @@
 
 #include "rendering/RenderingSubsystem.hpp"
 #include "concurrency/ThreadPool.hpp"
+#include "concurrency/AsyncSemaphore.hpp"
 #include "concurrency/BlockingThreadPool.hpp"
+#include "concurrency/BoundedScope.hpp"
+#include "concurrency/FrameArena.hpp"
+#include "concurrency/IoScheduler.hpp"
+#include "concurrency/MemoryStats.hpp"
+#include "concurrency/PooledTask.hpp"
+#include "concurrency/TimerWheel.hpp"
+#include "core/EngineConfig.hpp"
+#include "core/EnginePhases.hpp"
 #include "core/EngineHandle.hpp"
 #include "assets/AssetSubsystem.hpp"
 #include "InputHandler.hpp"
@@ -16,7 +27,7 @@
 constexpr auto APP_NAME = "HipNg";
 
 
-// Forces GLFW to initialize before everything else via an inheritance trick
+// Forces GLFW and the flecs OS API to initialize before everything else via an inheritance trick
 struct EngineBase
 {
     EngineBase();
@@ -43,15 +54,29 @@ public:
     
 private:
     unifex::task<int> mainEventLoop();
+    PooledTask<void> runFramePhase(FramePhase phase);
+    // Takes the permits of every frame submitted so far, true if there were any
+    bool drainSubmittedFrames();
+    void logSchedulerStats();
+    FrameArena::Lease leaseFrameArena();
 
 private:
     using Clock = std::chrono::steady_clock;
     Clock::time_point last_tick_;
 
     flecs::world world_;
+
+    // Has to be initialized before the pools
+    EngineConfig config_;
     
     ThreadPool main_thread_pool_;
     BlockingThreadPool blocking_thread_pool_;
+    TimerWheel timer_wheel_{main_thread_pool_.get_scheduler()};
+    IoScheduler io_scheduler_{main_thread_pool_.get_scheduler(), blocking_thread_pool_.get_scheduler()};
+
+    // Frame packets get destroyed out of order, so one extra arena is needed
+    // for the frame being simulated while all the inflight ones render
+    std::array<FrameArena, EngineHandle::MAX_INFLIGHT_FRAMES + 1> frame_arenas_;
 
     std::unique_ptr<RenderingSubsystem> renderer_;
     std::unique_ptr<AssetSubsystem> asset_subsystem_;
@@ -61,8 +86,18 @@ private:
     std::size_t inflight_frames_ {2}; // TODO: replace with a config
 
     unifex::async_scope global_scope_;
+    BoundedScope load_scope_{config_.max_concurrent_loads};
     // Hack: interaction with an OS window should only happen on the same thread
     // where the shceduler was created. This sender sends a void from that thread.
     ThreadPool::Scheduler::Sender os_polling_sender_{};
-    EventQueue next_frame_events_;
+    std::array<EventQueue, FRAME_PHASE_COUNT> frame_events_;
+    // Released by renderFrame once the frame is on the GPU queue, one permit per frame.
+    // Only ever polled, the main loop doesn't wait for rendering to catch up
+    AsyncSemaphore frame_submitted_{0};
+
+    // Previous samples, so that only the last interval gets logged
+    PoolStats last_main_stats_;
+    PoolStats last_blocking_stats_;
+    MemoryStats last_ecs_memory_;
+    Clock::time_point last_stats_time_{Clock::now()};
 };
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "concurrency/ThreadAffinity.hpp"
+
+
+enum class WorkerAffinity
+{
+    // Let the OS decide (but still keep off the reserved CPUs)
+    None,
+    // Every worker gets a single CPU
+    Cores,
+    // Workers are spread over NUMA nodes and can move within their node
+    Numa,
+};
+
+/**
+ * Engine-wide settings, read from a yaml file and overridden from the command line.
+ * Has to be loaded before anything that depends on it gets constructed.
+ */
+struct EngineConfig
+{
+    std::filesystem::path config_path;
+
+    // 0 means one worker per available CPU
+    std::size_t worker_threads{0};
+    // Blocking threads kept alive even when idle, 0 means a quarter of the available CPUs
+    std::size_t blocking_threads{0};
+    // The blocking pool grows up to this while its threads are stuck, 0 means twice the available CPUs
+    std::size_t max_blocking_threads{0};
+    // 0 means half of the workers
+    std::size_t max_background_tasks{0};
+    // Asset loads spawned through EngineHandle::asyncLoad running at the same time
+    std::size_t max_concurrent_loads{8};
+
+    WorkerAffinity affinity{WorkerAffinity::None};
+    // Restricts all threads to a single NUMA node
+    std::optional<std::size_t> numa_node;
+    // CPUs dedicated to the OS polling worker (worker 0), nothing else runs there
+    CpuSet reserved_cpus;
+
+    // Log scheduler counters every this many frames, 0 disables it
+    std::size_t scheduler_stats_interval{0};
+    // Record a trace and write it here on exit, only works in builds with tracing
+    std::optional<std::filesystem::path> trace_path;
+
+    // Everything below is derived from the settings above
+    std::vector<CpuSet> worker_affinities;
+    std::vector<CpuSet> blocking_affinities;
+
+
+    static EngineConfig load(std::string_view app_name, int argc, char** argv);
+
+private:
+    void loadFile(const std::filesystem::path& path);
+    void resolveTopology();
+};
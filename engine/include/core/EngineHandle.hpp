@@ -7,6 +7,9 @@
 #include "concurrency/ThreadPool.hpp"
 #include "concurrency/BlockingThreadPool.hpp"
 #include "concurrency/EventQueue.hpp"
+#include "concurrency/IoScheduler.hpp"
+#include "concurrency/TimerWheel.hpp"
+#include "core/EnginePhases.hpp"
 
 
 class Engine;
@@ -35,8 +38,10 @@ public:
 
     /**
      * Use this scheduler for most work.
+     * Critical is for work the current frame waits on,
+     * background is for streaming and other work that can wait.
      */
-    ThreadPool::Scheduler mainScheduler();
+    ThreadPool::Scheduler mainScheduler(TaskPriority priority = TaskPriority::Normal);
 
     /**
      * Use this scheduler for long, blocking tasks
@@ -44,11 +49,49 @@ public:
     BlockingThreadPool::Scheduler blockingScheduler();
 
 
+    /**
+     * Resumes at the given point of the next frame.
+     * Thread-safe events of a phase are spread over the main pool instead of
+     * running one by one on the main thread.
+     */
+    EventQueue::Scheduler frameScheduler(FramePhase phase, bool thread_safe = false);
+
+    /**
+     * Same as the BeforeSimulation phase
+     */
     EventQueue::Scheduler nextFrameScheduler();
 
+    /**
+     * Use this scheduler to wait for a delay or a deadline without blocking a thread.
+     * Resumes on the main scheduler.
+     */
+    TimerWheel::Scheduler timerScheduler();
+
+    /**
+     * Use this for reading files without blocking a thread per read.
+     * Reads complete on the main scheduler.
+     */
+    IoScheduler& io();
+
+
+    /**
+     * Counters of the schedulers above, can be sampled from any thread.
+     * Subtract two samples to get the stats for the time between them.
+     */
+    PoolStats mainPoolStats();
+    PoolStats blockingPoolStats();
+    EventQueueStats frameEventStats(FramePhase phase);
+
 
     void async(unifex::any_sender_of<> task);
 
+    /**
+     * Like async, but only a limited amount of these run at the same time.
+     * Use it for asset loads and uploads, so that requesting lots of them
+     * doesn't flood the blocking pool and the staging memory.
+     */
+    void asyncLoad(unifex::any_sender_of<> task);
+
 
     flecs::world& world();
     
@@ -10,6 +10,21 @@
 struct TGameLoopStarting {};
 struct TGameLoopFinished {};
 
+// Points in a frame where deferred events get executed, in this order
+enum class FramePhase
+{
+    BeforeSimulation,
+    // The frame packet is filled in, but not yet handed to rendering
+    AfterSimulation,
+    // Start of the first frame after one or more earlier frames got submitted and presented.
+    // Rendering isn't waited for, so it runs a frame or more late, or not at all that frame.
+    AfterRenderSubmit,
+    // Last thing in the frame, after the frame's own bookkeeping
+    EndOfFrame,
+};
+
+constexpr std::size_t FRAME_PHASE_COUNT = 4;
+
 template<class Tag>
 flecs::query<> query_for_tag(flecs::world& world)
 {
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "concurrency/MemoryStats.hpp"
+
+
+// Points the flecs OS API at engine primitives: allocations go through the
+// FrameAllocator pools and get counted, mutexes are AdaptiveMutexes and time
+// comes from the steady clock. Threads are left to flecs' defaults.
+// Has to be called before the first flecs world is created.
+void install_flecs_os_api();
+
+// Everything flecs has allocated so far
+MemoryStats flecs_memory_stats();
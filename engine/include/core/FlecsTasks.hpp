@@ -0,0 +1,9 @@
+#pragma once
+
+#include "concurrency/ThreadPool.hpp"
+
+
+// Makes flecs run the stages of multi-threaded systems as tasks on the given pool
+// instead of spawning a second set of threads. Has to be called before task
+// threads get enabled on a world.
+void install_flecs_task_hooks(ThreadPool::Scheduler scheduler);
@@ -1,11 +1,36 @@
 #pragma once
 
+#include <cstdint>
+#include <flecs.h>
 #include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
 #include <glm/gtc/quaternion.hpp>
 
 
+// Transform relative to the parent (the target of ChildOf), or to the world for roots.
+// Whoever changes it has to set dirty, otherwise the world transform stays stale.
 struct CPosition
 {
 	glm::vec3 position;
 	glm::quat rotation;
+	glm::vec3 scale{1.f};
+	bool dirty{true};
 };
+
+// Cached result of CPosition and all of the parents, added together with CPosition.
+// Written only by the transform system, read by everyone else.
+struct CWorldTransform
+{
+	glm::mat4 matrix{1.f};
+	// Bumped on every recompute, so that children notice their parent moving
+	std::uint32_t version{0};
+	// Every scale along the chain was uniform, normals can skip the inverse
+	bool uniform_scale{true};
+
+	// What the matrix was last built from
+	flecs::entity_t parent{0};
+	std::uint32_t parent_version{0};
+};
+
+// Runs between OnUpdate, where things move, and PostUpdate, where they get sent to rendering
+void register_transform_systems(flecs::world& world);
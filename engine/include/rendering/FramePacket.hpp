@@ -1,9 +1,11 @@
 #pragma once
 
+#include <memory_resource>
 #include <unordered_map>
 #include <vector>
 
 #include "assets/AssetHandle.hpp"
+#include "concurrency/FrameArena.hpp"
 #include "rendering/gui/GuiFramePacket.hpp"
 #include "shader_cpp_bridge/static_mesh.h"
 
@@ -14,21 +16,41 @@ struct StaticMeshPacket
 {
 	glm::mat4x4 transform;
 	AssetHandle model;
+	bool uniform_scale;
 };
 
 /**
- * Should have all the data required for a frame to be rendered
+ * Should have all the data required for a frame to be rendered.
+ * Its containers, as well as scratch data of whoever renders it,
+ * live in the frame's arena, which gets freed together with the packet.
  */
 struct FramePacket
 {
+	FramePacket() = default;
+
+	explicit FramePacket(FrameArena::Lease lease)
+		: arena{std::move(lease)}
+		, static_meshes{memory()}
+		, gui_packets{memory()}
+	{
+	}
+
+	std::pmr::memory_resource* memory() const { return arena.resource(); }
+
+	// Declared first, so that it is released last
+	FrameArena::Lease arena;
+
 	glm::mat4x4 view;
 	float fov;
 	float aspect; // HANDLED BY RENDERER
 	float near;
 	float far;
-	std::vector<StaticMeshPacket> static_meshes;
 
-	std::unordered_map<ImGuiContext*, GuiFramePacket> gui_packets;
+	// One list per flecs stage, so that systems running on different
+	// threads never push into the same vector
+	std::pmr::vector<std::pmr::vector<StaticMeshPacket>> static_meshes;
+
+	std::pmr::unordered_map<ImGuiContext*, GuiFramePacket> gui_packets;
 };
 
 struct CCurrentFramePacket
@@ -7,7 +7,10 @@
 #include <unifex/task.hpp>
 #include <unifex/async_manual_reset_event.hpp>
 
+#include "concurrency/AsyncSemaphore.hpp"
 #include "concurrency/EventQueue.hpp"
+#include "concurrency/PooledTask.hpp"
+#include "concurrency/TaskGraph.hpp"
 #include "util/Assert.hpp"
 #include "rendering/Window.hpp"
 #include "rendering/FramePacket.hpp"
@@ -31,8 +34,11 @@ public:
     /**
      * Warning: other public interface methods should NOT be called from this function.
      * That would lead to a asynchronous deadlock :)
+     * Releases one permit of submitted once the frame's work is on the GPU queue and
+     * presented, or once it gives up on the frame.
      */
-    [[nodiscard]] unifex::task<void> renderFrame(std::size_t frame_index, FramePacket packet);
+    [[nodiscard]] PooledTask<void> renderFrame(std::size_t frame_index, FramePacket packet,
+        AsyncSemaphore& submitted);
 
     [[nodiscard]] vk::Instance getInstance() const { return instance_.get(); }
 
@@ -57,6 +63,10 @@ private:
         return static_cast<uint32_t>(it - queues.begin());
     }
 
+    void rebuildPrepareGraph(std::size_t window_count);
+    PooledTask<void> acquireImage(std::size_t window);
+    PooledTask<void> recordUploads();
+
     static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
 	    VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
 	    VkDebugUtilsMessageTypeFlagsEXT messageType,
@@ -104,4 +114,22 @@ private:
     std::optional<Oneshot> oneshot_;
 
     std::unique_ptr<GpuStorageManager> gpu_storage_manager_;
+
+    // Inputs and outputs of a single prepare_graph_ run
+    struct FramePrep
+    {
+        std::size_t frame_index;
+        vk::CommandBuffer upload_cb;
+        std::vector<Window*> windows;
+        std::vector<std::optional<Window::SwapchainImage>> images;
+        std::optional<GpuStorageManager::UploadResult> uploads;
+    };
+
+    /**
+     * Acquiring swapchain images of different windows and recording the uploads
+     * don't depend on each other, so they all run at once. Only ever run under
+     * frame_mutex_, rebuilt when the amount of windows changes.
+     */
+    std::unique_ptr<TaskGraph> prepare_graph_;
+    FramePrep prep_;
 };
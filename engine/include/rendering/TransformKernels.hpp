@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+
+// Batch kernels for turning transforms into matrices, meant to be fed whole
+// flecs tables or draw lists at a time. They work on 4 (SSE) or 8 (AVX2)
+// matrices at once, the widest variant the CPU supports is picked on first use.
+// All spans of a call have to be the same size, out may alias the inputs.
+
+// out[i] = T(positions[i]) * R(rotations[i]) * S(scales[i])
+void compose_trs(std::span<const glm::vec3> positions, std::span<const glm::quat> rotations,
+    std::span<const glm::vec3> scales, std::span<glm::mat4> out);
+
+// out[i] = lhs[i] * rhs[i]
+void multiply_matrices(std::span<const glm::mat4> lhs, std::span<const glm::mat4> rhs, std::span<glm::mat4> out);
+
+// out[i] = lhs * rhs[i]
+void multiply_matrices(const glm::mat4& lhs, std::span<const glm::mat4> rhs, std::span<glm::mat4> out);
+
+// out[i] = transpose(inverse(mat3(models[i]))), translation dropped.
+// Matrices flagged as uniformly scaled skip the inverse, but only whole SIMD
+// blocks of them do, so flagged matrices are best kept next to each other.
+void normal_matrices(std::span<const glm::mat4> models, std::span<const std::uint8_t> uniform_scale,
+    std::span<glm::mat4> out);
+
+// Whether the upper 3x3 is a rotation times a uniform scale
+bool has_uniform_scale(const glm::mat4& m, float tolerance = 1e-4f);
+
+// Name of the instruction set the kernels ended up using
+const char* transform_kernels_isa();
+
+// Makes every kernel use the given instruction set ("sse2" or "avx2" on x86, "scalar" elsewhere),
+// nullptr goes back to the best one. Returns false if the CPU or the build doesn't have it.
+// Meant for tests and benchmarks, nothing else should be running kernels meanwhile.
+bool force_transform_kernels_isa(const char* isa);
@@ -7,7 +7,9 @@
 #include <flecs.h>
 #include <function2/function2.hpp>
 #include <unifex/async_mutex.hpp>
+#include <unifex/task.hpp>
 
+#include "concurrency/PooledTask.hpp"
 #include "primitives/InflightResource.hpp"
 #include "util/HeapArray.hpp"
 
@@ -44,7 +46,7 @@ public:
      * This is needed as a swapchain MIGHT return the same image twice in a row, therefore forcing us to limit
      * our concurrency
      */
-    unifex::task<std::optional<SwapchainImage>> acquireNext(std::size_t frame_index);
+    PooledTask<std::optional<SwapchainImage>> acquireNext(std::size_t frame_index);
 
     /**
      * Same as above, false means swapchain needs recreation.
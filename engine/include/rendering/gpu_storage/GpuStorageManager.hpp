@@ -1,7 +1,7 @@
 #pragma once
 
-#include <unordered_map>
-#include <unordered_set>
+#include <variant>
+#include <vector>
 #include <vulkan/vulkan.hpp>
 #include <tiny_gltf.h>
 #include <unifex/task.hpp>
@@ -9,7 +9,8 @@
 #include <unifex/async_manual_reset_event.hpp>
 
 #include "assets/AssetHandle.hpp"
-#include "concurrency/Spinlock.hpp"
+#include "concurrency/ConcurrentHashMap.hpp"
+#include "concurrency/PooledTask.hpp"
 #include "rendering/gpu_storage/StaticMesh.hpp"
 
 
@@ -27,7 +28,8 @@ public:
 	explicit GpuStorageManager(CreateInfo info);
 
 	unifex::task<void> uploadStaticMesh(AssetHandle handle, const tinygltf::Model& model);
-	StaticMesh* getStaticMesh(AssetHandle handle);
+	// Doesn't lock, the mesh stays valid for as long as the manager lives
+	StaticMesh* getStaticMesh(const AssetHandle& handle);
 
 	unifex::task<void> uploadGuiData(ImGuiContext* context);
 
@@ -39,7 +41,7 @@ public:
 		std::vector<ImGuiContext*> gui_contexts;
 	};
 
-	unifex::task<UploadResult> frameUpload(vk::CommandBuffer cb);
+	PooledTask<UploadResult> frameUpload(vk::CommandBuffer cb);
 
 	void frameUploadDone(UploadResult result);
 
@@ -57,8 +59,8 @@ private:
 	std::vector<ImGuiContext*> gui_context_uploads_; // guarded by uploads_mtx
 	unifex::async_mutex uploads_mtx_;
 
-	std::unordered_set<AssetHandle> uploaded_assets_; // guarded by uploaded_mtx_
-	unifex::async_mutex uploaded_mtx_;
+	// Assets which have been requested to be uploaded at some point
+	ConcurrentHashMap<AssetHandle, std::monostate> uploaded_assets_;
 
-	std::unordered_map<AssetHandle, StaticMesh> static_meshes_;
+	ConcurrentHashMap<AssetHandle, StaticMesh> static_meshes_;
 };
@@ -13,6 +13,7 @@ struct Meshlet
 	uint32_t index_offset;
 	uint32_t index_count;
 	glm::mat4x4 local_transform;
+	bool uniform_scale;
 	Material* material;
 };
 
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+
+// Tracing is on in debug builds, define NG_TRACING to 0 or 1 to override that
+#ifndef NG_TRACING
+#ifdef NDEBUG
+#define NG_TRACING 0
+#else
+#define NG_TRACING 1
+#endif
+#endif
+
+
+enum class TraceEventType : std::uint8_t
+{
+    // Synchronous zones, have to begin and end on the same thread
+    Begin,
+    End,
+    // Zones that may end on a different thread, e.g. across a co_await
+    AsyncBegin,
+    AsyncEnd,
+    // Arrows from the place where work got scheduled to where it ran
+    FlowStart,
+    FlowEnd,
+};
+
+#if NG_TRACING
+
+namespace detail
+{
+
+bool trace_enabled() noexcept;
+
+}
+
+// Events are only recorded while enabled. Recording is lock-free,
+// every thread writes into its own buffer.
+void trace_set_enabled(bool enabled) noexcept;
+
+// Names have to outlive the trace, so use string literals
+void trace_record(TraceEventType type, const char* name, std::uint64_t id = 0) noexcept;
+
+// Unique ids for async zones and flows
+std::uint64_t trace_next_id() noexcept;
+
+void trace_set_thread_name(std::string name);
+
+// Writes everything recorded so far in the Chrome trace event format,
+// which Perfetto and chrome://tracing can open. Can be called at any time.
+bool write_chrome_trace(const std::filesystem::path& path);
+
+class TraceZone
+{
+public:
+    explicit TraceZone(const char* name) noexcept
+        : name_{detail::trace_enabled() ? name : nullptr}
+    {
+        if (name_ != nullptr)
+        {
+            trace_record(TraceEventType::Begin, name_);
+        }
+    }
+
+    TraceZone(const TraceZone&) = delete;
+    TraceZone& operator=(const TraceZone&) = delete;
+
+    ~TraceZone() noexcept
+    {
+        if (name_ != nullptr)
+        {
+            trace_record(TraceEventType::End, name_);
+        }
+    }
+
+private:
+    const char* name_;
+};
+
+// Can live in a coroutine frame and end on a different thread than it began
+class AsyncTraceZone
+{
+public:
+    explicit AsyncTraceZone(const char* name) noexcept
+        : name_{detail::trace_enabled() ? name : nullptr}
+        , id_{name_ != nullptr ? trace_next_id() : 0}
+    {
+        if (name_ != nullptr)
+        {
+            trace_record(TraceEventType::AsyncBegin, name_, id_);
+        }
+    }
+
+    AsyncTraceZone(const AsyncTraceZone&) = delete;
+    AsyncTraceZone& operator=(const AsyncTraceZone&) = delete;
+
+    ~AsyncTraceZone() noexcept
+    {
+        if (name_ != nullptr)
+        {
+            trace_record(TraceEventType::AsyncEnd, name_, id_);
+        }
+    }
+
+private:
+    const char* name_;
+    std::uint64_t id_;
+};
+
+// Links the zone enclosing start to the zone enclosing finish
+class TraceFlow
+{
+public:
+    void start(const char* name) noexcept
+    {
+        id_ = detail::trace_enabled() ? trace_next_id() : 0;
+        if (id_ != 0)
+        {
+            trace_record(TraceEventType::FlowStart, name, id_);
+        }
+    }
+
+    void finish(const char* name) noexcept
+    {
+        if (id_ != 0)
+        {
+            trace_record(TraceEventType::FlowEnd, name, id_);
+        }
+    }
+
+private:
+    std::uint64_t id_{0};
+};
+
+#define NG_TRACE_CONCAT_IMPL(a, b) a##b
+#define NG_TRACE_CONCAT(a, b) NG_TRACE_CONCAT_IMPL(a, b)
+
+#define NG_TRACE_ZONE(name) TraceZone NG_TRACE_CONCAT(ng_trace_zone_, __LINE__){name}
+#define NG_TRACE_ASYNC_ZONE(name) AsyncTraceZone NG_TRACE_CONCAT(ng_trace_async_zone_, __LINE__){name}
+#define NG_TRACE_THREAD_NAME(name) trace_set_thread_name(name)
+
+#else
+
+inline void trace_set_enabled(bool) noexcept {}
+
+inline bool write_chrome_trace(const std::filesystem::path&) { return false; }
+
+// Empty, so that ops can keep one around for free
+class TraceFlow
+{
+public:
+    void start(const char*) noexcept {}
+    void finish(const char*) noexcept {}
+};
+
+#define NG_TRACE_ZONE(name) do { (void) (name); } while (false)
+#define NG_TRACE_ASYNC_ZONE(name) do { (void) (name); } while (false)
+#define NG_TRACE_THREAD_NAME(name) do {} while (false)
+
+#endif
@@ -3,6 +3,7 @@
 #include <unifex/on.hpp>
 
 #include "core/EngineHandle.hpp"
+#include "util/Trace.hpp"
 
 
 AssetSubsystem::AssetSubsystem(CreateInfo info)
@@ -12,28 +13,40 @@ AssetSubsystem::AssetSubsystem(CreateInfo info)
 
 unifex::task<tinygltf::Model> AssetSubsystem::loadModel(AssetHandle handle)
 {
-	co_await unifex::schedule(g_engine.blockingScheduler());
+	NG_TRACE_ASYNC_ZONE("AssetSubsystem::loadModel");
 
 	auto asset_path = base_path_ / handle.path;
 
 	auto ext = handle.path.extension().string();
 
+	if (ext != ".gltf" && ext != ".glb")
+	{
+		throw std::runtime_error("Unsupported model format!");
+	}
+
+	auto bytes = co_await g_engine.io().read_file(asset_path);
+
 	tinygltf::Model result;
 	std::string error;
 	std::string warn;
 	bool res;
 
+	auto base_dir = asset_path.parent_path().string();
+
 	if (ext == ".gltf")
 	{
-		res = loader_.LoadASCIIFromFile(&result, &error, &warn, asset_path.string());
-	}
-	else if (ext == ".glb")
-	{
-		res = loader_.LoadBinaryFromFile(&result, &error, &warn, asset_path.string());
+		// External buffers and images are still read synchronously by tinygltf
+		co_await unifex::schedule(g_engine.blockingScheduler());
+		NG_TRACE_ZONE("Parse glTF");
+		res = loader_.LoadASCIIFromString(&result, &error, &warn,
+			reinterpret_cast<const char*>(bytes.data()), static_cast<unsigned int>(bytes.size()), base_dir);
 	}
 	else
 	{
-		throw std::runtime_error("Unsupported model format!");
+		co_await unifex::schedule(g_engine.mainScheduler(TaskPriority::Background));
+		NG_TRACE_ZONE("Parse glb");
+		res = loader_.LoadBinaryFromMemory(&result, &error, &warn,
+			reinterpret_cast<const unsigned char*>(bytes.data()), static_cast<unsigned int>(bytes.size()), base_dir);
 	}
 
 	if (!res)
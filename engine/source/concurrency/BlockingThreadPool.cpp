@@ -0,0 +1,328 @@
+#include "concurrency/BlockingThreadPool.hpp"
+
+#include <algorithm>
+
+#include <spdlog/spdlog.h>
+
+
+BlockingThreadPool::BlockingThreadPool(std::size_t min_threads, std::size_t max_threads,
+    std::vector<CpuSet> affinities)
+    : min_threads_{std::max<std::size_t>(min_threads, 1)}
+    , max_threads_{std::max(max_threads, min_threads_)}
+    , affinities_{std::move(affinities)}
+    , threads_(max_threads_)
+    , counters_(max_threads_)
+{
+    free_slots_.reserve(max_threads_);
+    for (std::size_t i = max_threads_; i > 0; --i)
+    {
+        free_slots_.push_back(i - 1);
+    }
+    exited_slots_.reserve(max_threads_);
+
+    {
+        std::lock_guard lock{mtx_};
+        for (std::size_t i = 0; i < min_threads_; ++i)
+        {
+            spawn_thread();
+        }
+    }
+
+    if (max_threads_ > min_threads_)
+    {
+        monitor_ = std::thread([this]() { monitor_loop(); });
+    }
+}
+
+void BlockingThreadPool::request_stop() noexcept
+{
+    stop_requested_.store(true, std::memory_order::relaxed);
+    {
+        std::lock_guard lock{mtx_};
+    }
+    tasks_available_.notify_all();
+    monitor_wakeup_.notify_all();
+}
+
+BlockingThreadPool::~BlockingThreadPool() noexcept
+{
+    // The monitor is the only one spawning threads, so nothing changes after it is gone
+    if (monitor_.joinable())
+    {
+        monitor_.join();
+    }
+
+    for (auto& thread : threads_)
+    {
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+}
+
+void BlockingThreadPool::enqueue(QueuedOpBase* op)
+{
+    op->enqueued_at = Clock::now();
+    op->flow.start("BlockingThreadPool hop");
+    incoming_.push(op);
+
+    // Pairs with the decrement in thread_loop: either the sleeper sees
+    // our op or we see the sleeper. If everyone is busy, the monitor takes care of it.
+    if (sleeping_count_.load(std::memory_order::seq_cst) == 0)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard lock{mtx_};
+    }
+    tasks_available_.notify_one();
+}
+
+PoolStats BlockingThreadPool::stats()
+{
+    PoolStats result;
+    result.workers.reserve(counters_.size());
+    for (auto& counters : counters_)
+    {
+        result.workers.push_back(counters.snapshot());
+    }
+
+    std::lock_guard lock{mtx_};
+    drain_incoming();
+    result.queued_tasks = waiting_count_;
+
+    return result;
+}
+
+void BlockingThreadPool::try_cancel(QueuedOpBase* op)
+{
+    std::unique_lock lock{mtx_};
+    // The op might still be in the incoming queue
+    drain_incoming();
+    if (!op->queued)
+    {
+        // Already running or not queued yet
+        return;
+    }
+    unlink(op);
+    lock.unlock();
+
+    op->cancel();
+}
+
+void BlockingThreadPool::drain_incoming()
+{
+    for (auto current = incoming_.pop_all(); current != nullptr;)
+    {
+        auto next = current->next;
+        auto op = static_cast<QueuedOpBase*>(current);
+        op->next = nullptr;
+        op->prev = waiting_last_;
+        op->queued = true;
+        if (waiting_last_ == nullptr)
+        {
+            waiting_first_ = op;
+        }
+        else
+        {
+            waiting_last_->next = op;
+        }
+        waiting_last_ = op;
+        ++waiting_count_;
+        current = next;
+    }
+}
+
+void BlockingThreadPool::unlink(QueuedOpBase* op)
+{
+    auto next = static_cast<QueuedOpBase*>(op->next);
+    if (op->prev != nullptr)
+    {
+        op->prev->next = next;
+    }
+    else
+    {
+        waiting_first_ = next;
+    }
+
+    if (next != nullptr)
+    {
+        next->prev = op->prev;
+    }
+    else
+    {
+        waiting_last_ = op->prev;
+    }
+
+    op->next = nullptr;
+    op->prev = nullptr;
+    op->queued = false;
+    --waiting_count_;
+}
+
+BlockingThreadPool::QueuedOpBase* BlockingThreadPool::pop_waiting()
+{
+    if (waiting_first_ == nullptr)
+    {
+        drain_incoming();
+    }
+
+    auto op = waiting_first_;
+    if (op != nullptr)
+    {
+        unlink(op);
+    }
+    return op;
+}
+
+bool BlockingThreadPool::has_waiting()
+{
+    return waiting_first_ != nullptr || !incoming_.empty();
+}
+
+void BlockingThreadPool::spawn_thread()
+{
+    NG_ASSERT(!free_slots_.empty());
+    auto slot = free_slots_.back();
+    free_slots_.pop_back();
+    ++thread_count_;
+
+    CpuSet cpus = affinities_.empty() ? CpuSet{} : affinities_[slot % affinities_.size()];
+    // The new thread can't exit before this assignment, as it needs mtx_ for that
+    threads_[slot] = std::thread([this, slot, cpus = std::move(cpus)]()
+        {
+            if (!set_current_thread_affinity(cpus))
+            {
+                spdlog::warn("Unable to set the affinity of a blocking worker");
+            }
+            NG_TRACE_THREAD_NAME(fmt::format("Blocking worker {}", slot));
+            thread_loop(slot);
+        });
+}
+
+void BlockingThreadPool::join_exited(std::unique_lock<std::mutex>& lock)
+{
+    if (exited_slots_.empty())
+    {
+        return;
+    }
+
+    std::vector<std::thread> exited;
+    exited.reserve(exited_slots_.size());
+    for (auto slot : exited_slots_)
+    {
+        exited.push_back(std::move(threads_[slot]));
+        free_slots_.push_back(slot);
+    }
+    exited_slots_.clear();
+
+    lock.unlock();
+    for (auto& thread : exited)
+    {
+        thread.join();
+    }
+    lock.lock();
+}
+
+void BlockingThreadPool::thread_loop(std::size_t slot)
+{
+    std::unique_lock lock{mtx_};
+    while (!stop_requested_.load(std::memory_order::relaxed))
+    {
+        if (auto op = pop_waiting())
+        {
+            ++started_ops_;
+            lock.unlock();
+            counters_[slot].task_started(op->enqueued_at, false);
+            op->wake();
+            lock.lock();
+            continue;
+        }
+
+        sleeping_count_.fetch_add(1, std::memory_order::seq_cst);
+        auto parked_at = Clock::now();
+        bool woken = tasks_available_.wait_for(lock, IDLE_TIMEOUT,
+            [this]()
+            {
+                return stop_requested_.load(std::memory_order::relaxed) || has_waiting();
+            });
+        auto still_sleeping = sleeping_count_.fetch_sub(1, std::memory_order::seq_cst) - 1;
+        counters_[slot].parked(Clock::now() - parked_at);
+
+        if (woken)
+        {
+            // We might have been the last idle thread
+            if (still_sleeping == 0 && thread_count_ < max_threads_)
+            {
+                monitor_wakeup_.notify_one();
+            }
+            continue;
+        }
+
+        // Ops pushed after the wait timed out could have missed us, so check once more
+        if (thread_count_ > min_threads_ && !has_waiting())
+        {
+            --thread_count_;
+            exited_slots_.push_back(slot);
+            monitor_wakeup_.notify_one();
+            return;
+        }
+    }
+
+    drain_incoming();
+    auto current = waiting_first_;
+    for (auto op = current; op != nullptr; op = static_cast<QueuedOpBase*>(op->next))
+    {
+        op->queued = false;
+    }
+    waiting_first_ = nullptr;
+    waiting_last_ = nullptr;
+    waiting_count_ = 0;
+    lock.unlock();
+
+    while (current != nullptr)
+    {
+        auto next = current->next;
+        current->cancel();
+        current = static_cast<QueuedOpBase*>(next);
+    }
+}
+
+void BlockingThreadPool::monitor_loop()
+{
+    std::unique_lock lock{mtx_};
+    while (!stop_requested_.load(std::memory_order::relaxed))
+    {
+        join_exited(lock);
+
+        if (sleeping_count_.load(std::memory_order::seq_cst) != 0 || thread_count_ >= max_threads_)
+        {
+            monitor_wakeup_.wait(lock,
+                [this]()
+                {
+                    return stop_requested_.load(std::memory_order::relaxed)
+                        || !exited_slots_.empty()
+                        || (sleeping_count_.load(std::memory_order::seq_cst) == 0
+                            && thread_count_ < max_threads_);
+                });
+            continue;
+        }
+
+        // Everyone is busy, but that is fine as long as the queue keeps moving
+        auto started = started_ops_;
+        if (monitor_wakeup_.wait_for(lock, SPAWN_DELAY,
+            [this]() { return stop_requested_.load(std::memory_order::relaxed); }))
+        {
+            break;
+        }
+
+        if (sleeping_count_.load(std::memory_order::seq_cst) == 0 && started == started_ops_
+            && has_waiting() && thread_count_ < max_threads_)
+        {
+            join_exited(lock);
+            spawn_thread();
+        }
+    }
+}
@@ -0,0 +1,77 @@
+#include "concurrency/EventQueue.hpp"
+
+#include "concurrency/ParallelFor.hpp"
+
+
+void EventQueue::executeAll()
+{
+    executeSerial();
+    recordDrain(concurrent_executed_, last_concurrent_batch_, wakeAll(concurrent_events_.pop_all()));
+}
+
+void EventQueue::executeSerial()
+{
+    // Events enqueued while executing are left for the next call
+    recordDrain(serial_executed_, last_serial_batch_, wakeAll(events_.pop_all()));
+}
+
+PooledTask<void> EventQueue::executeConcurrent(ThreadPool::Scheduler scheduler)
+{
+    concurrent_batch_.clear();
+    for (auto current = concurrent_events_.pop_all(); current != nullptr; current = current->next)
+    {
+        concurrent_batch_.push_back(current);
+    }
+    recordDrain(concurrent_executed_, last_concurrent_batch_, concurrent_batch_.size());
+
+    // wake might delete the op, so next pointers can't be used after this point
+    co_await parallel_for(scheduler, concurrent_batch_.size(),
+        [this](std::size_t i)
+        {
+            concurrent_batch_[i]->wake();
+        });
+}
+
+EventQueueStats EventQueue::stats() const
+{
+    return EventQueueStats{
+        .serial_events = serial_executed_.load(std::memory_order::relaxed),
+        .concurrent_events = concurrent_executed_.load(std::memory_order::relaxed),
+        .last_serial_batch = last_serial_batch_.load(std::memory_order::relaxed),
+        .last_concurrent_batch = last_concurrent_batch_.load(std::memory_order::relaxed),
+    };
+}
+
+EventQueue::~EventQueue() noexcept
+{
+    for (auto queue : {&events_, &concurrent_events_})
+    {
+        auto current = queue->pop_all();
+        while (current != nullptr)
+        {
+            auto next = current->next;
+            current->cancel();
+            current = next;
+        }
+    }
+}
+
+std::size_t EventQueue::wakeAll(OpBase* current)
+{
+    std::size_t count = 0;
+    while (current != nullptr)
+    {
+        auto next = current->next;
+        // wake might delete current
+        current->wake();
+        current = next;
+        ++count;
+    }
+    return count;
+}
+
+void EventQueue::recordDrain(std::atomic<std::uint64_t>& total, std::atomic<std::size_t>& last, std::size_t count)
+{
+    total.store(total.load(std::memory_order::relaxed) + count, std::memory_order::relaxed);
+    last.store(count, std::memory_order::relaxed);
+}
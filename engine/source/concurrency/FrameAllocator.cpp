@@ -0,0 +1,187 @@
+#include "concurrency/FrameAllocator.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <mutex>
+#include <new>
+
+#include "concurrency/AdaptiveMutex.hpp"
+
+
+namespace
+{
+
+constexpr std::size_t MIN_CLASS_SHIFT = 7;
+constexpr std::size_t CLASS_COUNT = std::bit_width(FrameAllocator::MAX_POOLED_SIZE) - MIN_CLASS_SHIFT;
+// Blocks moved between a thread cache and the central list at a time
+constexpr std::size_t BATCH_SIZE = 32;
+constexpr std::size_t MAX_CACHED = 2 * BATCH_SIZE;
+
+static_assert(std::has_single_bit(FrameAllocator::MAX_POOLED_SIZE));
+
+struct FreeBlock
+{
+    FreeBlock* next;
+};
+
+std::size_t size_class(std::size_t size)
+{
+    return size <= (std::size_t{1} << MIN_CLASS_SHIFT)
+        ? 0 : std::bit_width(size - 1) - MIN_CLASS_SHIFT;
+}
+
+std::size_t class_size(std::size_t cls)
+{
+    return std::size_t{1} << (cls + MIN_CLASS_SHIFT);
+}
+
+// Takes up to count blocks off the front of a list, returns the rest
+FreeBlock* split(FreeBlock* list, std::size_t count, FreeBlock*& tail)
+{
+    tail = list;
+    for (std::size_t i = 1; i < count && tail->next != nullptr; ++i)
+    {
+        tail = tail->next;
+    }
+    auto rest = tail->next;
+    tail->next = nullptr;
+    return rest;
+}
+
+class CentralList
+{
+public:
+    // Returns nullptr if there is nothing to take
+    FreeBlock* take_batch(std::size_t& count)
+    {
+        std::lock_guard lock{mutex_};
+        if (head_ == nullptr)
+        {
+            count = 0;
+            return nullptr;
+        }
+
+        FreeBlock* tail;
+        auto batch = head_;
+        head_ = split(head_, BATCH_SIZE, tail);
+        count = std::min(BATCH_SIZE, size_);
+        size_ -= count;
+        return batch;
+    }
+
+    void give(FreeBlock* first, FreeBlock* last, std::size_t count)
+    {
+        std::lock_guard lock{mutex_};
+        last->next = head_;
+        head_ = first;
+        size_ += count;
+    }
+
+    ~CentralList()
+    {
+        while (head_ != nullptr)
+        {
+            auto next = head_->next;
+            ::operator delete(head_);
+            head_ = next;
+        }
+    }
+
+private:
+    AdaptiveMutex mutex_;
+    FreeBlock* head_{nullptr};
+    std::size_t size_{0};
+};
+
+std::array<CentralList, CLASS_COUNT>& central_lists()
+{
+    static std::array<CentralList, CLASS_COUNT> lists;
+    return lists;
+}
+
+struct ThreadCache
+{
+    ThreadCache()
+    {
+        // The central lists have to outlive every cache
+        central_lists();
+    }
+
+    ~ThreadCache()
+    {
+        for (std::size_t cls = 0; cls < CLASS_COUNT; ++cls)
+        {
+            if (heads[cls] != nullptr)
+            {
+                FreeBlock* tail;
+                split(heads[cls], counts[cls], tail);
+                central_lists()[cls].give(heads[cls], tail, counts[cls]);
+            }
+        }
+    }
+
+    std::array<FreeBlock*, CLASS_COUNT> heads{};
+    std::array<std::size_t, CLASS_COUNT> counts{};
+};
+
+thread_local ThreadCache thread_cache;
+
+}
+
+void* FrameAllocator::allocate(std::size_t size)
+{
+    if (size > MAX_POOLED_SIZE)
+    {
+        return ::operator new(size);
+    }
+
+    auto cls = size_class(size);
+    auto& cache = thread_cache;
+
+    if (cache.heads[cls] == nullptr)
+    {
+        cache.heads[cls] = central_lists()[cls].take_batch(cache.counts[cls]);
+        if (cache.heads[cls] == nullptr)
+        {
+            return ::operator new(class_size(cls));
+        }
+    }
+
+    auto block = cache.heads[cls];
+    cache.heads[cls] = block->next;
+    --cache.counts[cls];
+    return block;
+}
+
+void FrameAllocator::deallocate(void* ptr, std::size_t size) noexcept
+{
+    if (size > MAX_POOLED_SIZE)
+    {
+        ::operator delete(ptr);
+        return;
+    }
+
+    auto cls = size_class(size);
+    auto& cache = thread_cache;
+
+    auto block = static_cast<FreeBlock*>(ptr);
+    block->next = cache.heads[cls];
+    cache.heads[cls] = block;
+    ++cache.counts[cls];
+
+    // Threads that mostly free frames allocated elsewhere hand the excess over
+    if (cache.counts[cls] > MAX_CACHED)
+    {
+        FreeBlock* tail;
+        auto batch = cache.heads[cls];
+        cache.heads[cls] = split(batch, BATCH_SIZE, tail);
+        cache.counts[cls] -= BATCH_SIZE;
+        central_lists()[cls].give(batch, tail, BATCH_SIZE);
+    }
+}
+
+std::size_t FrameAllocator::usable_size(std::size_t size) noexcept
+{
+    return size > MAX_POOLED_SIZE ? size : class_size(size_class(size));
+}
@@ -0,0 +1,131 @@
+#include "concurrency/FrameArena.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+
+#include "util/Assert.hpp"
+
+
+namespace
+{
+
+std::atomic<std::size_t> g_next_arena_id{0};
+
+}
+
+// A single thread's part of an arena. Only that thread touches it while
+// the arena is leased, the leasing thread resets it in between.
+struct FrameArena::Region
+{
+    struct Chunk
+    {
+        std::unique_ptr<std::byte[]> data;
+        std::size_t size;
+    };
+
+    void* allocate(std::size_t bytes, std::size_t alignment)
+    {
+        if (auto result = bump(bytes, alignment))
+        {
+            return result;
+        }
+
+        // Reuse the chunks from previous frames first, skipping the ones too small
+        auto needed = bytes + alignment;
+        while (++current < chunks.size())
+        {
+            if (chunks[current].size >= needed)
+            {
+                enter(current);
+                return bump(bytes, alignment);
+            }
+        }
+
+        auto size = std::max(CHUNK_SIZE, needed);
+        chunks.push_back(Chunk{std::unique_ptr<std::byte[]>(new std::byte[size]), size});
+        enter(chunks.size() - 1);
+        return bump(bytes, alignment);
+    }
+
+    void* bump(std::size_t bytes, std::size_t alignment)
+    {
+        auto address = reinterpret_cast<std::uintptr_t>(cursor);
+        auto aligned = (address + alignment - 1) & ~(alignment - 1);
+        if (cursor == nullptr || aligned + bytes > reinterpret_cast<std::uintptr_t>(end))
+        {
+            return nullptr;
+        }
+
+        cursor = reinterpret_cast<std::byte*>(aligned + bytes);
+        return reinterpret_cast<void*>(aligned);
+    }
+
+    void enter(std::size_t chunk)
+    {
+        current = chunk;
+        cursor = chunks[chunk].data.get();
+        end = cursor + chunks[chunk].size;
+    }
+
+    void reset()
+    {
+        current = 0;
+        cursor = chunks.empty() ? nullptr : chunks[0].data.get();
+        end = chunks.empty() ? nullptr : cursor + chunks[0].size;
+    }
+
+    std::vector<Chunk> chunks;
+    std::size_t current{0};
+    std::byte* cursor{nullptr};
+    std::byte* end{nullptr};
+};
+
+FrameArena::FrameArena()
+    : id_{g_next_arena_id.fetch_add(1, std::memory_order::relaxed)}
+{
+}
+
+FrameArena::~FrameArena() noexcept
+{
+    NG_ASSERTF(!leased_.load(std::memory_order::acquire), "Frame arena destroyed while leased!");
+}
+
+FrameArena::Lease FrameArena::try_lease()
+{
+    if (leased_.exchange(true, std::memory_order::acq_rel))
+    {
+        return Lease{};
+    }
+
+    std::lock_guard lock{mutex_};
+    for (auto& region : regions_)
+    {
+        region->reset();
+    }
+
+    return Lease{this};
+}
+
+void* FrameArena::do_allocate(std::size_t bytes, std::size_t alignment)
+{
+    NG_ASSERT(leased_.load(std::memory_order::relaxed));
+    return region_for_this_thread().allocate(bytes, alignment);
+}
+
+FrameArena::Region& FrameArena::region_for_this_thread()
+{
+    // Indexed by arena id
+    thread_local std::vector<Region*> t_regions;
+
+    if (id_ < t_regions.size() && t_regions[id_] != nullptr)
+    {
+        return *t_regions[id_];
+    }
+
+    t_regions.resize(std::max(t_regions.size(), id_ + 1), nullptr);
+
+    std::lock_guard lock{mutex_};
+    t_regions[id_] = regions_.emplace_back(std::make_unique<Region>()).get();
+    return *t_regions[id_];
+}
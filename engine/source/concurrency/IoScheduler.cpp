@@ -0,0 +1,533 @@
+#include "concurrency/IoScheduler.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <thread>
+#include <utility>
+
+#include <spdlog/spdlog.h>
+
+#if defined(__linux__)
+#   include <fcntl.h>
+#   include <linux/io_uring.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <sys/syscall.h>
+#   include <unistd.h>
+#elif defined(_WIN32)
+#   define WIN32_LEAN_AND_MEAN
+#   define NOMINMAX
+#   include <Windows.h>
+#endif
+
+#include "util/Assert.hpp"
+#include "util/Trace.hpp"
+
+
+namespace
+{
+
+constexpr std::intptr_t INVALID_FILE = -1;
+
+#if defined(__linux__)
+int io_uring_setup(unsigned entries, io_uring_params* params)
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+// Marks the nop that wakes up the reaper on shutdown
+constexpr std::uint64_t STOP_USER_DATA = 0;
+#endif
+
+}
+
+AsyncFile::AsyncFile(const std::filesystem::path& path)
+{
+#if defined(__linux__)
+    handle_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (handle_ < 0)
+    {
+        throw std::system_error(errno, std::generic_category(), "Unable to open " + path.string());
+    }
+#elif defined(_WIN32)
+    auto handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        throw std::system_error(static_cast<int>(GetLastError()), std::system_category(),
+            "Unable to open " + path.string());
+    }
+    handle_ = reinterpret_cast<std::intptr_t>(handle);
+#endif
+}
+
+AsyncFile::AsyncFile(AsyncFile&& other) noexcept
+    : handle_{std::exchange(other.handle_, INVALID_FILE)}
+{
+}
+
+AsyncFile& AsyncFile::operator=(AsyncFile&& other) noexcept
+{
+    if (this != &other)
+    {
+        close();
+        handle_ = std::exchange(other.handle_, INVALID_FILE);
+    }
+    return *this;
+}
+
+AsyncFile::~AsyncFile() noexcept
+{
+    close();
+}
+
+void AsyncFile::close() noexcept
+{
+    if (handle_ == INVALID_FILE)
+    {
+        return;
+    }
+
+#if defined(__linux__)
+    ::close(static_cast<int>(handle_));
+#elif defined(_WIN32)
+    CloseHandle(reinterpret_cast<HANDLE>(handle_));
+#endif
+    handle_ = INVALID_FILE;
+}
+
+std::uint64_t AsyncFile::size() const
+{
+#if defined(__linux__)
+    struct stat info;
+    if (fstat(static_cast<int>(handle_), &info) != 0)
+    {
+        throw std::system_error(errno, std::generic_category(), "Unable to stat a file");
+    }
+    return static_cast<std::uint64_t>(info.st_size);
+#elif defined(_WIN32)
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(reinterpret_cast<HANDLE>(handle_), &size))
+    {
+        throw std::system_error(static_cast<int>(GetLastError()), std::system_category(),
+            "Unable to get a file size");
+    }
+    return static_cast<std::uint64_t>(size.QuadPart);
+#endif
+}
+
+std::int64_t AsyncFile::read_at(std::span<std::byte> buffer, std::uint64_t offset) const noexcept
+{
+#if defined(__linux__)
+    ssize_t result;
+    do
+    {
+        result = ::pread(static_cast<int>(handle_), buffer.data(), buffer.size(), static_cast<off_t>(offset));
+    }
+    while (result < 0 && errno == EINTR);
+    return result < 0 ? -errno : result;
+#elif defined(_WIN32)
+    OVERLAPPED overlapped{};
+    overlapped.Offset = static_cast<DWORD>(offset);
+    overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+    DWORD read = 0;
+    auto size = static_cast<DWORD>(std::min<std::size_t>(buffer.size(), MAXDWORD));
+    if (!ReadFile(reinterpret_cast<HANDLE>(handle_), buffer.data(), size, &read, &overlapped))
+    {
+        return GetLastError() == ERROR_HANDLE_EOF ? 0 : -EIO;
+    }
+    return read;
+#endif
+}
+
+IoScheduler::IoScheduler(ThreadPool::Scheduler resume_scheduler, BlockingThreadPool::Scheduler fallback_scheduler,
+    std::size_t queue_depth)
+    : resume_scheduler_{resume_scheduler}
+    , fallback_scheduler_{fallback_scheduler}
+{
+    if (setup_ring(queue_depth))
+    {
+        reaper_ = std::thread([this]()
+            {
+                NG_TRACE_THREAD_NAME("IO reaper");
+                reaper_loop();
+            });
+    }
+    else
+    {
+        spdlog::info("io_uring is not available, file reads will block the blocking pool");
+    }
+}
+
+IoScheduler::~IoScheduler() noexcept
+{
+    if (reaper_.joinable())
+    {
+        reaper_.join();
+    }
+    destroy_ring();
+}
+
+unifex::task<std::size_t> IoScheduler::read_exactly(IoScheduler& io, const AsyncFile& file,
+    std::span<std::byte> buffer, std::uint64_t offset)
+{
+    std::size_t total = 0;
+    while (total < buffer.size())
+    {
+        std::size_t read = co_await io.read_some(file, buffer.subspan(total), offset + total);
+        if (read == 0)
+        {
+            break;
+        }
+        total += read;
+    }
+    co_return total;
+}
+
+unifex::task<std::vector<std::byte>> IoScheduler::read_range(std::filesystem::path path,
+    std::uint64_t offset, std::size_t size)
+{
+    AsyncFile file(path);
+
+    auto file_size = file.size();
+    size = offset < file_size ? static_cast<std::size_t>(std::min<std::uint64_t>(size, file_size - offset)) : 0;
+
+    std::vector<std::byte> result(size);
+    result.resize(co_await read_exactly(*this, file, result, offset));
+    co_return result;
+}
+
+unifex::task<std::vector<std::byte>> IoScheduler::read_file(std::filesystem::path path)
+{
+    AsyncFile file(path);
+
+    std::vector<std::byte> result(static_cast<std::size_t>(file.size()));
+    result.resize(co_await read_exactly(*this, file, result, 0));
+    co_return result;
+}
+
+#if defined(__linux__)
+
+bool IoScheduler::setup_ring(std::size_t queue_depth)
+{
+    io_uring_params params{};
+    int fd = io_uring_setup(static_cast<unsigned>(queue_depth), &params);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    // IORING_OP_READ appeared in the same kernel version as this feature
+    if ((params.features & IORING_FEAT_RW_CUR_POS) == 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    ring_fd_ = fd;
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap)
+    {
+        sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+
+    auto map = [fd](std::size_t size, off_t offset) -> void*
+        {
+            void* result = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+            return result == MAP_FAILED ? nullptr : result;
+        };
+
+    sq_ring_ = map(sq_ring_size_, IORING_OFF_SQ_RING);
+    cq_ring_ = single_mmap ? sq_ring_ : map(cq_ring_size_, IORING_OFF_CQ_RING);
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = map(sqes_size_, IORING_OFF_SQES);
+
+    if (sq_ring_ == nullptr || cq_ring_ == nullptr || sqes_ == nullptr)
+    {
+        destroy_ring();
+        return false;
+    }
+
+    auto sq = static_cast<std::byte*>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_entries_ = params.sq_entries;
+
+    auto cq = static_cast<std::byte*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqes_ = cq + params.cq_off.cqes;
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+
+    return true;
+}
+
+void IoScheduler::destroy_ring() noexcept
+{
+    if (sqes_ != nullptr)
+    {
+        munmap(sqes_, sqes_size_);
+    }
+    if (cq_ring_ != nullptr && cq_ring_ != sq_ring_)
+    {
+        munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_ != nullptr)
+    {
+        munmap(sq_ring_, sq_ring_size_);
+    }
+    sqes_ = cq_ring_ = sq_ring_ = nullptr;
+
+    if (ring_fd_ >= 0)
+    {
+        ::close(ring_fd_);
+        ring_fd_ = -1;
+    }
+}
+
+bool IoScheduler::submit(ReadOpBase* op)
+{
+    if (ring_fd_ < 0)
+    {
+        return false;
+    }
+
+    std::unique_lock lock{mtx_};
+    if (stop_requested_)
+    {
+        lock.unlock();
+        op->cancel();
+        return true;
+    }
+
+    // One slot is kept for the stop nop. The completion queue is twice as large,
+    // so it can never overflow.
+    if (in_flight_ + 1 >= sq_entries_)
+    {
+        op->next = nullptr;
+        (pending_last_ != nullptr ? pending_last_->next : pending_first_) = op;
+        pending_last_ = op;
+        return true;
+    }
+
+    push_sqe(op);
+    return true;
+}
+
+void IoScheduler::push_sqe(ReadOpBase* op)
+{
+    std::atomic_ref<unsigned> sq_tail{*sq_tail_};
+
+    auto tail = sq_tail.load(std::memory_order::relaxed);
+    auto idx = tail & sq_mask_;
+    auto& sqe = static_cast<io_uring_sqe*>(sqes_)[idx];
+    sqe = io_uring_sqe{};
+
+    if (op != nullptr)
+    {
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = static_cast<int>(op->file->native_handle());
+        sqe.addr = reinterpret_cast<std::uint64_t>(op->buffer.data());
+        // Larger reads are split by read_exactly anyway
+        sqe.len = static_cast<std::uint32_t>(std::min<std::size_t>(op->buffer.size(), 1u << 30));
+        sqe.off = op->offset;
+        sqe.user_data = reinterpret_cast<std::uint64_t>(static_cast<OpBase*>(op));
+        ++in_flight_;
+    }
+    else
+    {
+        sqe.opcode = IORING_OP_NOP;
+        sqe.user_data = STOP_USER_DATA;
+    }
+
+    sq_array_[idx] = idx;
+    sq_tail.store(tail + 1, std::memory_order::release);
+
+    flush_sqes();
+}
+
+void IoScheduler::flush_sqes()
+{
+    std::atomic_ref<unsigned> sq_tail{*sq_tail_};
+    std::atomic_ref<unsigned> sq_head{*sq_head_};
+
+    // Nobody else would submit entries left in the ring, so keep going until it is empty
+    bool warned = false;
+    while (true)
+    {
+        auto to_submit = sq_tail.load(std::memory_order::relaxed) - sq_head.load(std::memory_order::acquire);
+        if (to_submit == 0)
+        {
+            return;
+        }
+
+        // Partial submissions simply go around again
+        auto result = io_uring_enter(ring_fd_, to_submit, 0, 0);
+        if (result > 0 || (result < 0 && errno == EINTR))
+        {
+            continue;
+        }
+
+        // Out of kernel resources, or the completion queue is backed up until the reaper catches up
+        if (result == 0 || errno == EAGAIN || errno == EBUSY)
+        {
+            if (!std::exchange(warned, true))
+            {
+                spdlog::warn("io_uring is busy, retrying the submission of {} reads", to_submit);
+            }
+            std::this_thread::yield();
+            continue;
+        }
+
+        spdlog::error("io_uring_enter failed with {}, {} reads are stuck", errno, to_submit);
+        return;
+    }
+}
+
+void IoScheduler::submit_pending()
+{
+    while (pending_first_ != nullptr && in_flight_ + 1 < sq_entries_)
+    {
+        auto op = pending_first_;
+        pending_first_ = op->next;
+        if (pending_first_ == nullptr)
+        {
+            pending_last_ = nullptr;
+        }
+        push_sqe(static_cast<ReadOpBase*>(op));
+    }
+}
+
+void IoScheduler::request_stop() noexcept
+{
+    if (ring_fd_ < 0)
+    {
+        return;
+    }
+
+    std::unique_lock lock{mtx_};
+    if (stop_requested_)
+    {
+        return;
+    }
+    stop_requested_ = true;
+
+    auto current = pending_first_;
+    pending_first_ = nullptr;
+    pending_last_ = nullptr;
+    push_sqe(nullptr);
+    lock.unlock();
+
+    while (current != nullptr)
+    {
+        auto next = current->next;
+        current->cancel();
+        current = next;
+    }
+}
+
+void IoScheduler::reaper_loop()
+{
+    std::atomic_ref<unsigned> cq_tail{*cq_tail_};
+    std::atomic_ref<unsigned> cq_head{*cq_head_};
+    auto cqes = static_cast<io_uring_cqe*>(cqes_);
+
+    struct Completion
+    {
+        OpBase* op;
+        std::int64_t result;
+    };
+    std::vector<Completion> completions;
+
+    bool stop_seen = false;
+    while (true)
+    {
+        if (io_uring_enter(ring_fd_, 0, 1, IORING_ENTER_GETEVENTS) < 0
+            && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        {
+            spdlog::error("io_uring_enter failed with {} while waiting for completions", errno);
+        }
+
+        auto head = cq_head.load(std::memory_order::relaxed);
+        auto tail = cq_tail.load(std::memory_order::acquire);
+        for (; head != tail; ++head)
+        {
+            auto& cqe = cqes[head & cq_mask_];
+            if (cqe.user_data == STOP_USER_DATA)
+            {
+                stop_seen = true;
+                continue;
+            }
+            completions.push_back({reinterpret_cast<OpBase*>(cqe.user_data), cqe.res});
+        }
+        cq_head.store(head, std::memory_order::release);
+
+        bool finished;
+        {
+            std::lock_guard lock{mtx_};
+            in_flight_ -= completions.size();
+            submit_pending();
+            finished = stop_seen && in_flight_ == 0;
+        }
+
+        for (auto [op, result] : completions)
+        {
+            op->wake(result);
+        }
+        completions.clear();
+
+        if (finished)
+        {
+            break;
+        }
+    }
+}
+
+#else
+
+bool IoScheduler::setup_ring(std::size_t)
+{
+    return false;
+}
+
+void IoScheduler::destroy_ring() noexcept
+{
+}
+
+bool IoScheduler::submit(ReadOpBase*)
+{
+    return false;
+}
+
+void IoScheduler::push_sqe(ReadOpBase*)
+{
+}
+
+void IoScheduler::flush_sqes()
+{
+}
+
+void IoScheduler::submit_pending()
+{
+}
+
+void IoScheduler::request_stop() noexcept
+{
+}
+
+void IoScheduler::reaper_loop()
+{
+}
+
+#endif
@@ -0,0 +1,269 @@
+#include "concurrency/TaskGraph.hpp"
+
+#include <optional>
+#include <unifex/manual_lifetime.hpp>
+
+#include "util/Assert.hpp"
+#include "util/Trace.hpp"
+
+
+struct TaskGraph::Node
+{
+    struct ScheduleReceiver
+    {
+        void set_value() && noexcept
+        {
+            node->graph->execute(*node);
+        }
+
+        // The pool is shutting down, finish without running the body
+        void set_done() && noexcept
+        {
+            node->graph->node_finished(*node);
+        }
+
+        void set_error(std::exception_ptr e) && noexcept
+        {
+            node->graph->fail(std::move(e));
+            node->graph->node_finished(*node);
+        }
+
+        Node* node;
+    };
+
+    struct TaskReceiver
+    {
+        void set_value() && noexcept
+        {
+            node->graph->node_finished(*node);
+        }
+
+        void set_done() && noexcept
+        {
+            node->graph->node_finished(*node);
+        }
+
+        void set_error(std::exception_ptr e) && noexcept
+        {
+            node->graph->fail(std::move(e));
+            node->graph->node_finished(*node);
+        }
+
+        Node* node;
+    };
+
+    using ScheduleOp = unifex::connect_result_t<ThreadPool::Scheduler::Sender, ScheduleReceiver>;
+    using TaskOp = unifex::connect_result_t<PooledTask<void>, TaskReceiver>;
+
+    TaskGraph* graph;
+    const char* name;
+    std::function<void()> work;
+    std::function<PooledTask<void>()> task;
+    std::optional<std::size_t> thread;
+
+    std::vector<NodeId> successors;
+    std::size_t dependency_count{0};
+    std::atomic<std::size_t> pending{0};
+
+    // Ops of the latest run, destroyed when the next one starts
+    unifex::manual_lifetime<ScheduleOp> schedule_op;
+    bool schedule_op_alive{false};
+    unifex::manual_lifetime<TaskOp> task_op;
+    bool task_op_alive{false};
+
+    void destroy_ops() noexcept
+    {
+        if (schedule_op_alive)
+        {
+            schedule_op.destruct();
+            schedule_op_alive = false;
+        }
+        if (task_op_alive)
+        {
+            task_op.destruct();
+            task_op_alive = false;
+        }
+    }
+};
+
+TaskGraph::TaskGraph(ThreadPool::Scheduler scheduler)
+    : scheduler_{scheduler}
+{
+}
+
+TaskGraph::~TaskGraph() noexcept
+{
+    NG_ASSERTF(run_op_ == nullptr, "Task graph destroyed while running!");
+    for (auto& node : nodes_)
+    {
+        node->destroy_ops();
+    }
+}
+
+TaskGraph::NodeId TaskGraph::add(const char* name, std::function<void()> work)
+{
+    auto node = std::make_unique<Node>();
+    node->name = name;
+    node->work = std::move(work);
+    return add_node(std::move(node));
+}
+
+TaskGraph::NodeId TaskGraph::add_pinned(const char* name, std::size_t thread, std::function<void()> work)
+{
+    NG_ASSERT(thread < scheduler_.thread_count());
+    auto node = std::make_unique<Node>();
+    node->name = name;
+    node->work = std::move(work);
+    node->thread = thread;
+    return add_node(std::move(node));
+}
+
+TaskGraph::NodeId TaskGraph::add_async(const char* name, std::function<PooledTask<void>()> task)
+{
+    auto node = std::make_unique<Node>();
+    node->name = name;
+    node->task = std::move(task);
+    return add_node(std::move(node));
+}
+
+TaskGraph::NodeId TaskGraph::add_node(std::unique_ptr<Node> node)
+{
+    NG_ASSERTF(run_op_ == nullptr, "Can't change a running task graph!");
+    node->graph = this;
+    nodes_.emplace_back(std::move(node));
+    return nodes_.size() - 1;
+}
+
+void TaskGraph::depends_on(NodeId node, NodeId dependency)
+{
+    NG_ASSERTF(run_op_ == nullptr, "Can't change a running task graph!");
+    NG_ASSERTF(dependency < node, "Dependencies have to be added before their dependents!");
+
+    nodes_[dependency]->successors.push_back(node);
+    ++nodes_[node]->dependency_count;
+}
+
+void TaskGraph::begin_run(void* op, CompleteFunc complete) noexcept
+{
+    NG_ASSERTF(run_op_ == nullptr, "Task graph is already running!");
+
+    run_op_ = op;
+    complete_ = complete;
+    failed_.store(false, std::memory_order::relaxed);
+    error_ = nullptr;
+
+    roots_.clear();
+    for (std::size_t i = 0; i < nodes_.size(); ++i)
+    {
+        auto& node = *nodes_[i];
+        node.destroy_ops();
+        node.pending.store(node.dependency_count, std::memory_order::relaxed);
+        if (node.dependency_count == 0)
+        {
+            roots_.push_back(i);
+        }
+    }
+
+    // The extra one keeps the run alive until all roots are launched
+    remaining_.store(nodes_.size() + 1, std::memory_order::relaxed);
+
+    for (auto root : roots_)
+    {
+        launch(*nodes_[root]);
+    }
+
+    release_run();
+}
+
+void TaskGraph::launch(Node& node) noexcept
+{
+    auto sender = node.thread.has_value()
+        ? scheduler_.schedule_on_thread(*node.thread)
+        : scheduler_.schedule();
+
+    node.schedule_op.construct_with([&]()
+        {
+            return unifex::connect(std::move(sender), Node::ScheduleReceiver{&node});
+        });
+    node.schedule_op_alive = true;
+    unifex::start(node.schedule_op.get());
+}
+
+void TaskGraph::execute(Node& node) noexcept
+{
+    // Skip everything once something failed, but keep the counters going
+    if (failed_.load(std::memory_order::relaxed))
+    {
+        node_finished(node);
+        return;
+    }
+
+    if (node.task)
+    {
+        try
+        {
+            PooledTask<void> task = node.task();
+            node.task_op.construct_with([&]()
+                {
+                    return unifex::connect(std::move(task), Node::TaskReceiver{&node});
+                });
+            node.task_op_alive = true;
+        }
+        catch (...)
+        {
+            fail(std::current_exception());
+            node_finished(node);
+            return;
+        }
+
+        unifex::start(node.task_op.get());
+        return;
+    }
+
+    try
+    {
+        NG_TRACE_ZONE(node.name);
+        node.work();
+    }
+    catch (...)
+    {
+        fail(std::current_exception());
+    }
+    node_finished(node);
+}
+
+void TaskGraph::node_finished(Node& node) noexcept
+{
+    // acq_rel makes the writes of all dependencies visible to the dependent
+    for (auto successor : node.successors)
+    {
+        auto& next = *nodes_[successor];
+        if (next.pending.fetch_sub(1, std::memory_order::acq_rel) == 1)
+        {
+            launch(next);
+        }
+    }
+
+    release_run();
+}
+
+void TaskGraph::fail(std::exception_ptr error) noexcept
+{
+    if (!failed_.exchange(true, std::memory_order::relaxed))
+    {
+        error_ = std::move(error);
+    }
+}
+
+void TaskGraph::release_run() noexcept
+{
+    if (remaining_.fetch_sub(1, std::memory_order::acq_rel) != 1)
+    {
+        return;
+    }
+
+    // The receiver might start the next run right away
+    auto op = std::exchange(run_op_, nullptr);
+    auto complete = std::exchange(complete_, nullptr);
+    complete(op, failed_.load(std::memory_order::relaxed) ? std::move(error_) : nullptr);
+}
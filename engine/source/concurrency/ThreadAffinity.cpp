@@ -0,0 +1,224 @@
+#include "concurrency/ThreadAffinity.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+
+#if defined(__linux__)
+#   include <pthread.h>
+#   include <sched.h>
+#elif defined(_WIN32)
+#   define WIN32_LEAN_AND_MEAN
+#   define NOMINMAX
+#   include <Windows.h>
+#endif
+
+
+namespace
+{
+
+CpuSet all_cpus()
+{
+    CpuSet result(std::max(1u, std::thread::hardware_concurrency()));
+    for (std::size_t i = 0; i < result.size(); ++i)
+    {
+        result[i] = i;
+    }
+    return result;
+}
+
+#if defined(__linux__)
+// Parses the kernel's "0-3,8,10-11" format
+CpuSet parse_cpu_list(const std::string& list)
+{
+    CpuSet result;
+
+    const char* current = list.data();
+    const char* end = list.data() + list.size();
+    while (current < end)
+    {
+        std::size_t first = 0;
+        auto [after_first, ec] = std::from_chars(current, end, first);
+        if (ec != std::errc{})
+        {
+            break;
+        }
+
+        std::size_t last = first;
+        current = after_first;
+        if (current < end && *current == '-')
+        {
+            auto [after_last, ec2] = std::from_chars(current + 1, end, last);
+            if (ec2 != std::errc{})
+            {
+                break;
+            }
+            current = after_last;
+        }
+
+        for (auto cpu = first; cpu <= last; ++cpu)
+        {
+            result.push_back(cpu);
+        }
+
+        if (current < end && *current == ',')
+        {
+            ++current;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    return result;
+}
+#endif
+
+}
+
+CpuSet process_cpus()
+{
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0)
+    {
+        return all_cpus();
+    }
+
+    CpuSet result;
+    for (std::size_t cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+        if (CPU_ISSET(cpu, &set))
+        {
+            result.push_back(cpu);
+        }
+    }
+    return result;
+#elif defined(_WIN32)
+    DWORD_PTR process_mask;
+    DWORD_PTR system_mask;
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask))
+    {
+        return all_cpus();
+    }
+
+    CpuSet result;
+    for (std::size_t cpu = 0; cpu < sizeof(DWORD_PTR) * 8; ++cpu)
+    {
+        if ((process_mask >> cpu) & 1)
+        {
+            result.push_back(cpu);
+        }
+    }
+    return result;
+#else
+    return all_cpus();
+#endif
+}
+
+std::vector<NumaNode> numa_nodes()
+{
+    std::vector<NumaNode> result;
+
+#if defined(__linux__)
+    // Node ids can have holes, e.g. with offline or memory-only nodes
+    const std::filesystem::path root{"/sys/devices/system/node"};
+    std::ifstream online_file{root / "online"};
+    std::string online;
+    std::getline(online_file, online);
+
+    for (auto node : parse_cpu_list(online))
+    {
+        std::ifstream file{root / ("node" + std::to_string(node)) / "cpulist"};
+        std::string list;
+        std::getline(file, list);
+        if (auto cpus = parse_cpu_list(list); !cpus.empty())
+        {
+            result.push_back({node, std::move(cpus)});
+        }
+    }
+#elif defined(_WIN32)
+    ULONG highest_node = 0;
+    if (GetNumaHighestNodeNumber(&highest_node))
+    {
+        for (ULONG node = 0; node <= highest_node; ++node)
+        {
+            ULONGLONG mask = 0;
+            if (!GetNumaNodeProcessorMask(static_cast<UCHAR>(node), &mask) || mask == 0)
+            {
+                continue;
+            }
+
+            CpuSet cpus;
+            for (std::size_t cpu = 0; cpu < 64; ++cpu)
+            {
+                if ((mask >> cpu) & 1)
+                {
+                    cpus.push_back(cpu);
+                }
+            }
+            result.push_back({node, std::move(cpus)});
+        }
+    }
+#endif
+
+    if (result.empty())
+    {
+        result.push_back({0, all_cpus()});
+    }
+
+    return result;
+}
+
+bool set_current_thread_affinity(const CpuSet& cpus)
+{
+    if (cpus.empty())
+    {
+        return true;
+    }
+
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto cpu : cpus)
+    {
+        if (cpu < CPU_SETSIZE)
+        {
+            CPU_SET(cpu, &set);
+        }
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+    DWORD_PTR mask = 0;
+    for (auto cpu : cpus)
+    {
+        if (cpu < sizeof(DWORD_PTR) * 8)
+        {
+            mask |= DWORD_PTR{1} << cpu;
+        }
+    }
+    return mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+    return false;
+#endif
+}
+
+CpuSet cpu_set_intersection(const CpuSet& a, const CpuSet& b)
+{
+    CpuSet result;
+    std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(result));
+    return result;
+}
+
+CpuSet cpu_set_difference(const CpuSet& a, const CpuSet& b)
+{
+    CpuSet result;
+    std::set_difference(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(result));
+    return result;
+}
@@ -1,112 +1,340 @@
 #include "concurrency/ThreadPool.hpp"
 
+#include <algorithm>
+#include <bit>
+
+#include <spdlog/spdlog.h>
+
 #include "util/Assert.hpp"
-#include "concurrency/MultiLock.hpp"
 
 
+thread_local ThreadPool* ThreadPool::this_thread_pool_ = nullptr;
 thread_local std::size_t ThreadPool::this_thread_idx_ = THREAD_NONE;
 
 
-ThreadPool::ThreadPool(std::size_t thread_count): thread_data_{thread_count}
+ThreadPool::ThreadPool(std::size_t thread_count, std::size_t max_background_tasks,
+    std::vector<CpuSet> affinities)
+    : thread_data_{thread_count}
+    , max_background_tasks_{max_background_tasks != 0
+        ? max_background_tasks : std::max<std::size_t>(1, thread_count / 2)}
+    , idle_workers_((thread_count + IDLE_WORD_BITS - 1) / IDLE_WORD_BITS)
 {
     NG_ASSERT(thread_count > 0);
     threads_.reserve(thread_count);
     for (std::size_t i = 0; i < thread_count; ++i)
     {
-        threads_.emplace_back([i, this]() { thread_loop(i); });
+        CpuSet cpus = affinities.empty() ? CpuSet{} : affinities[i % affinities.size()];
+        threads_.emplace_back([i, this, cpus = std::move(cpus)]()
+            {
+                if (!set_current_thread_affinity(cpus))
+                {
+                    spdlog::warn("Unable to set the affinity of worker {}", i);
+                }
+                NG_TRACE_THREAD_NAME(fmt::format("Worker {}", i));
+                thread_loop(i);
+            });
     }
 }
 
 void ThreadPool::request_stop() noexcept
 {
     stop_requested_.store(true, std::memory_order::relaxed);
+    notify_workers(true);
+}
+
+void ThreadPool::enqueue(OpBase* op, std::size_t requested_thread, TaskPriority priority)
+{
+    if (requested_thread != THREAD_NONE)
+    {
+        thread_data_[requested_thread].awaiting_start_pinned.push(op);
+        notify_worker(requested_thread);
+        return;
+    }
+
+    auto lane = static_cast<std::size_t>(priority);
+
+    if (this_thread_pool_ == this)
+    {
+        // Fast path: continuations spawned by our own workers go to the local deque
+        thread_data_[this_thread_idx_].deques[lane].push(op);
+    }
+    else
+    {
+        auto& injected = injected_[lane];
+        std::lock_guard lock{injected.lock};
+        injected.lot.park(op);
+        injected.count.fetch_add(1, std::memory_order::relaxed);
+    }
+
+    notify_workers(false);
+}
+
+void ThreadPool::task_started(Clock::time_point enqueued_at, bool pinned)
+{
+    thread_data_[this_thread_idx_].counters.task_started(enqueued_at, pinned);
+}
+
+PoolStats ThreadPool::stats() const
+{
+    PoolStats result;
+    result.workers.reserve(thread_data_.size());
     for (auto& data : thread_data_)
     {
-        data.any_awaiting.notify_one();
+        result.workers.push_back(data.counters.snapshot());
+        for (auto& deque : data.deques)
+        {
+            result.queued_tasks += deque.size();
+        }
     }
+
+    for (auto& injected : injected_)
+    {
+        result.queued_tasks += injected.count.load(std::memory_order::relaxed);
+        result.queue_locks += injected.lock.stats();
+    }
+
+    return result;
 }
 
-void ThreadPool::enqueue(OpBase* op, std::size_t requested_thread)
+void ThreadPool::notify_workers(bool all)
 {
-    if (requested_thread != THREAD_NONE)
+    // Pairs with the fence in park: either we see the idle bit
+    // or the worker sees our work
+    std::atomic_thread_fence(std::memory_order::seq_cst);
+
+    for (std::size_t w = 0; w < idle_workers_.size(); ++w)
     {
-        auto& data = thread_data_[requested_thread];
-        std::lock_guard lock{data.pinned_spinlock};
-        data.awaiting_start_pinned.park(op);
-        data.any_awaiting.notify_one();
-        return;
+        auto& word = idle_workers_[w];
+        auto mask = word.load(std::memory_order::relaxed);
+        while (mask != 0)
+        {
+            auto bit = std::uint64_t{1} << std::countr_zero(mask);
+            auto prev = word.fetch_and(~bit, std::memory_order::acq_rel);
+            // Whoever clears the bit is responsible for waking the worker up
+            if ((prev & bit) != 0)
+            {
+                wake(w * IDLE_WORD_BITS + static_cast<std::size_t>(std::countr_zero(bit)));
+                if (!all)
+                {
+                    return;
+                }
+            }
+            mask = prev & ~bit;
+        }
     }
+}
 
-    auto target_queue = current_thread_round_robin_.fetch_add(1, std::memory_order::relaxed) % threads_.size();
+void ThreadPool::notify_worker(std::size_t tid)
+{
+    std::atomic_thread_fence(std::memory_order::seq_cst);
 
-    for (std::size_t i = 0; i < threads_.size(); ++i)
+    auto& word = idle_workers_[tid / IDLE_WORD_BITS];
+    auto bit = std::uint64_t{1} << (tid % IDLE_WORD_BITS);
+    if ((word.load(std::memory_order::relaxed) & bit) != 0
+        && (word.fetch_and(~bit, std::memory_order::acq_rel) & bit) != 0)
     {
-        auto j = i + target_queue;
-        if (j >= threads_.size()) { j -= threads_.size(); }
+        wake(tid);
+    }
+}
+
+void ThreadPool::wake(std::size_t tid)
+{
+    auto& token = thread_data_[tid].wake_token;
+    token.store(1, std::memory_order::release);
+    token.notify_one();
+}
+
+void ThreadPool::park(std::size_t tid)
+{
+    auto& this_thread_data = thread_data_[tid];
+    auto& word = idle_workers_[tid / IDLE_WORD_BITS];
+    auto bit = std::uint64_t{1} << (tid % IDLE_WORD_BITS);
 
-        auto& data = thread_data_[j];
-        if (std::unique_lock lock{data.spinlock, std::try_to_lock})
+    this_thread_data.wake_token.store(0, std::memory_order::relaxed);
+    word.fetch_or(bit, std::memory_order::seq_cst);
+    std::atomic_thread_fence(std::memory_order::seq_cst);
+
+    if (!stop_requested_.load(std::memory_order::relaxed) && !has_work(tid))
+    {
+        auto parked_at = Clock::now();
+
+        // A stale token from a previous round can only cause a spurious wakeup
+        while (this_thread_data.wake_token.load(std::memory_order::acquire) == 0)
         {
-            data.awaiting_start.park(op);
-            data.any_awaiting.notify_one();
-            return;
+            this_thread_data.wake_token.wait(0, std::memory_order::acquire);
         }
+
+        this_thread_data.counters.parked(Clock::now() - parked_at);
     }
 
-    auto& data = thread_data_[target_queue];
-    std::lock_guard lock{data.spinlock};
-    data.awaiting_start.park(op);
-    data.any_awaiting.notify_one();
+    // Might've been cleared by a notifier already, that's fine
+    word.fetch_and(~bit, std::memory_order::relaxed);
 }
 
 void ThreadPool::thread_loop(std::size_t tid)
 {
+    this_thread_pool_ = this;
     this_thread_idx_ = tid;
 
 
     while (!stop_requested_.load(std::memory_order::relaxed))
     {
-        run_task();
+        if (run_task())
+        {
+            continue;
+        }
+
+        // Work usually comes in bursts, so spin a bit before paying for a syscall
+        bool found = false;
+        SpinWait spin;
+        for (std::size_t i = 0; i < SPIN_ROUNDS && !found; ++i)
+        {
+            spin();
+            found = run_task();
+        }
+
+        if (!found)
+        {
+            park(tid);
+        }
     }
 
 
     auto& this_thread_data = thread_data_[this_thread_idx_];
-    std::unique_lock lock{this_thread_data.spinlock};
-    multi_cancel_all(lock, this_thread_data.awaiting_start, this_thread_data.awaiting_start_pinned);
+
+    for (auto& deque : this_thread_data.deques)
+    {
+        while (auto op = deque.pop())
+        {
+            op->cancel();
+        }
+    }
+
+    while (auto op = this_thread_data.awaiting_start_pinned.pop())
+    {
+        op->cancel();
+    }
+
+    for (auto& injected : injected_)
+    {
+        std::unique_lock lock{injected.lock};
+        injected.count.store(0, std::memory_order::relaxed);
+        multi_cancel_all(lock, injected.lot);
+    }
 }
 
-void ThreadPool::run_task()
+bool ThreadPool::background_allowed() const
 {
-    auto& this_thread_data = thread_data_[this_thread_idx_];
+    return running_background_tasks_.load(std::memory_order::relaxed) < max_background_tasks_;
+}
 
-    if (std::unique_lock lock{this_thread_data.pinned_spinlock, std::try_to_lock};
-        lock && this_thread_data.awaiting_start_pinned.wake_one(lock))
+bool ThreadPool::has_work(std::size_t tid) const
+{
+    if (!thread_data_[tid].awaiting_start_pinned.empty())
     {
-        return;
+        return true;
     }
 
+    // Background work we aren't allowed to run doesn't count,
+    // we will be notified once a slot frees up
+    auto lanes = background_allowed() ? TASK_PRIORITY_COUNT : TASK_PRIORITY_COUNT - 1;
 
-    for (std::size_t i = 0; i < threads_.size(); ++i)
+    for (std::size_t lane = 0; lane < lanes; ++lane)
     {
-        auto j = i + this_thread_idx_;
-        if (j >= threads_.size()) { j -= threads_.size(); }
-        auto& queue_data = thread_data_[j];
-        if (std::unique_lock lock{queue_data.spinlock, std::try_to_lock};
-            lock && queue_data.awaiting_start.wake_one(lock))
+        if (injected_[lane].count.load(std::memory_order::relaxed) > 0)
+        {
+            return true;
+        }
+
+        for (auto& data : thread_data_)
         {
-            return;
+            if (!data.deques[lane].empty())
+            {
+                return true;
+            }
         }
     }
 
+    return false;
+}
+
+bool ThreadPool::run_task()
+{
+    if (auto op = thread_data_[this_thread_idx_].awaiting_start_pinned.pop())
+    {
+        op->wake();
+        return true;
+    }
+
+    return run_task(TaskPriority::Critical)
+        || run_task(TaskPriority::Normal)
+        || run_background_task();
+}
+
+bool ThreadPool::run_background_task()
+{
+    if (running_background_tasks_.fetch_add(1, std::memory_order::relaxed) >= max_background_tasks_)
+    {
+        running_background_tasks_.fetch_sub(1, std::memory_order::relaxed);
+        return false;
+    }
+
+    bool ran = run_task(TaskPriority::Background);
+
+    running_background_tasks_.fetch_sub(1, std::memory_order::seq_cst);
+
+    // Somebody might've gone to sleep while we were hogging the last slot
+    if (ran)
+    {
+        notify_workers(false);
+    }
+
+    return ran;
+}
+
+bool ThreadPool::run_task(TaskPriority priority)
+{
+    auto lane = static_cast<std::size_t>(priority);
 
-    MultiLock multilock(this_thread_data.pinned_spinlock, this_thread_data.spinlock);
-    std::unique_lock lock{multilock};
-    while (!stop_requested_.load(std::memory_order::relaxed)
-        && !this_thread_data.awaiting_start_pinned.wake_one(lock)
-        && !this_thread_data.awaiting_start.wake_one(lock))
+    if (auto op = thread_data_[this_thread_idx_].deques[lane].pop())
     {
-        this_thread_data.any_awaiting.wait(lock);
+        op->wake();
+        return true;
     }
+
+    if (auto& injected = injected_[lane]; injected.count.load(std::memory_order::relaxed) > 0)
+    {
+        std::unique_lock lock{injected.lock};
+        // The counter is only modified under the lock, so the lot can't be empty here
+        if (injected.count.load(std::memory_order::relaxed) > 0)
+        {
+            injected.count.fetch_sub(1, std::memory_order::relaxed);
+            injected.lot.wake_one(lock);
+            return true;
+        }
+    }
+
+    // Steal the oldest work from our neighbours
+    for (std::size_t i = 1; i < thread_data_.size(); ++i)
+    {
+        auto j = i + this_thread_idx_;
+        if (j >= thread_data_.size()) { j -= thread_data_.size(); }
+
+        auto& deque = thread_data_[j].deques[lane];
+        if (deque.empty())
+        {
+            continue;
+        }
+
+        if (auto op = deque.steal())
+        {
+            thread_data_[this_thread_idx_].counters.task_stolen();
+            op->wake();
+            return true;
+        }
+    }
+
+    return false;
 }
 
 ThreadPool::~ThreadPool() noexcept
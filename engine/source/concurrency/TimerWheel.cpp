@@ -0,0 +1,347 @@
+#include "concurrency/TimerWheel.hpp"
+
+#include <algorithm>
+#include <bit>
+
+#include "util/Trace.hpp"
+
+
+TimerWheel::TimerWheel(ThreadPool::Scheduler resume_scheduler, std::uint64_t start_tick)
+    : resume_scheduler_{resume_scheduler}
+    , epoch_{Clock::now() - Tick{static_cast<Tick::rep>(start_tick)}}
+    , current_tick_{start_tick}
+{
+    thread_ = std::thread([this]()
+        {
+            NG_TRACE_THREAD_NAME("Timer wheel");
+            thread_loop();
+        });
+}
+
+void TimerWheel::request_stop() noexcept
+{
+    stop_requested_.store(true, std::memory_order::relaxed);
+    {
+        std::lock_guard lock{mtx_};
+    }
+    wakeup_.notify_one();
+}
+
+void TimerWheel::enqueue(TimerOpBase* op)
+{
+    // The op might be gone as soon as it is pushed
+    auto tick = to_tick(op->deadline, true);
+    incoming_.push(op);
+
+    // Pairs with the store in thread_loop: either the timer thread
+    // sees our op before going to sleep or we see when it plans to wake up
+    if (tick >= planned_wakeup_tick_.load(std::memory_order::seq_cst))
+    {
+        return;
+    }
+
+    {
+        std::lock_guard lock{mtx_};
+    }
+    wakeup_.notify_one();
+}
+
+void TimerWheel::request_cancel(TimerOpBase* op)
+{
+    {
+        std::lock_guard lock{mtx_};
+        // Claimed under the lock, so that cancel_all knows every cancelled op is on the list
+        if (!op->claim(TimerOpBase::CANCELLED))
+        {
+            // Already fired
+            return;
+        }
+        op->next_cancelled = cancelled_;
+        cancelled_ = op;
+    }
+    wakeup_.notify_one();
+}
+
+void TimerWheel::thread_loop()
+{
+    while (!stop_requested_.load(std::memory_order::relaxed))
+    {
+        planned_wakeup_tick_.store(0, std::memory_order::relaxed);
+
+        drain_incoming();
+        process_cancelled(false);
+
+        auto next_tick = advance(to_tick(Clock::now(), false));
+
+        std::unique_lock lock{mtx_};
+        planned_wakeup_tick_.store(next_tick, std::memory_order::seq_cst);
+
+        auto should_wake = [this]()
+            {
+                return stop_requested_.load(std::memory_order::relaxed)
+                    || !incoming_.empty()
+                    || cancelled_ != nullptr;
+            };
+
+        if (next_tick == NO_TICK)
+        {
+            wakeup_.wait(lock, should_wake);
+        }
+        else
+        {
+            wakeup_.wait_until(lock, to_time_point(next_tick), should_wake);
+        }
+    }
+
+    cancel_all();
+}
+
+void TimerWheel::drain_incoming()
+{
+    for (auto current = incoming_.pop_all(); current != nullptr;)
+    {
+        // insert might fire the op and it might get destroyed
+        auto next = current->next;
+        auto op = static_cast<TimerOpBase*>(current);
+        op->arrived = true;
+        op->deadline_tick = to_tick(op->deadline, true);
+        insert(op);
+        current = next;
+    }
+}
+
+bool TimerWheel::process_cancelled(bool complete_inline)
+{
+    TimerOpBase* current;
+    {
+        std::lock_guard lock{mtx_};
+        current = std::exchange(cancelled_, nullptr);
+    }
+
+    bool any = current != nullptr;
+    while (current != nullptr)
+    {
+        auto next = current->next_cancelled;
+
+        // The stop callback can fire before start() has handed the op over,
+        // it shows up any moment now
+        while (!current->arrived)
+        {
+            std::this_thread::yield();
+            drain_incoming();
+        }
+
+        unlink(current);
+        if (complete_inline)
+        {
+            current->cancel();
+        }
+        else
+        {
+            // Hops to the pool, which sees the op was cancelled
+            current->wake();
+        }
+        current = next;
+    }
+
+    return any;
+}
+
+void TimerWheel::insert(TimerOpBase* op)
+{
+    if (op->deadline_tick <= current_tick_)
+    {
+        // A cancelled op stays out of the wheel, process_cancelled completes it
+        if (op->claim(TimerOpBase::FIRED))
+        {
+            op->wake();
+        }
+        return;
+    }
+
+    // Timers beyond what the wheel can address wait for it to wrap around
+    std::size_t level = LEVEL_COUNT;
+    std::size_t slot = 0;
+    TimerOpBase** head = &overflow_;
+    if ((op->deadline_tick ^ current_tick_) < WHEEL_SPAN)
+    {
+        // The level is determined by the highest bit that differs from the current tick
+        level = static_cast<std::size_t>(std::bit_width(op->deadline_tick ^ current_tick_) - 1) / SLOT_BITS;
+        slot = static_cast<std::size_t>(op->deadline_tick >> (level * SLOT_BITS)) & (SLOT_COUNT - 1);
+
+        auto& lvl = levels_[level];
+        head = &lvl.slots[slot];
+        lvl.occupied |= std::uint64_t{1} << slot;
+    }
+
+    op->level = static_cast<std::uint8_t>(level);
+    op->slot = static_cast<std::uint8_t>(slot);
+    op->prev = nullptr;
+    op->next = *head;
+    if (*head != nullptr)
+    {
+        (*head)->prev = op;
+    }
+    *head = op;
+}
+
+void TimerWheel::unlink(TimerOpBase* op)
+{
+    if (op->level == TimerOpBase::NOT_LINKED)
+    {
+        return;
+    }
+
+    auto next = static_cast<TimerOpBase*>(op->next);
+    if (next != nullptr)
+    {
+        next->prev = op->prev;
+    }
+
+    if (op->prev != nullptr)
+    {
+        op->prev->next = next;
+    }
+    else if (op->level == LEVEL_COUNT)
+    {
+        overflow_ = next;
+    }
+    else
+    {
+        auto& lvl = levels_[op->level];
+        lvl.slots[op->slot] = next;
+        if (next == nullptr)
+        {
+            lvl.occupied &= ~(std::uint64_t{1} << op->slot);
+        }
+    }
+
+    op->next = nullptr;
+    op->prev = nullptr;
+    op->level = TimerOpBase::NOT_LINKED;
+}
+
+std::uint64_t TimerWheel::next_slot_tick(std::size_t& level, std::size_t& slot) const
+{
+    // Everything on a lower level expires earlier than anything on a higher one
+    for (std::size_t i = 0; i < LEVEL_COUNT; ++i)
+    {
+        auto shift = i * SLOT_BITS;
+        auto current_slot = (current_tick_ >> shift) & (SLOT_COUNT - 1);
+        auto mask = levels_[i].occupied & (~std::uint64_t{0} << current_slot);
+        if (mask == 0)
+        {
+            continue;
+        }
+
+        level = i;
+        slot = static_cast<std::size_t>(std::countr_zero(mask));
+
+        auto level_start = current_tick_ & ~((std::uint64_t{1} << (shift + SLOT_BITS)) - 1);
+        return std::max(current_tick_, level_start + (std::uint64_t{slot} << shift));
+    }
+
+    if (overflow_ != nullptr)
+    {
+        level = LEVEL_COUNT;
+        return (current_tick_ | (WHEEL_SPAN - 1)) + 1;
+    }
+
+    return NO_TICK;
+}
+
+std::uint64_t TimerWheel::advance(std::uint64_t now_tick)
+{
+    std::size_t level;
+    std::size_t slot;
+    std::uint64_t tick;
+    while ((tick = next_slot_tick(level, slot)) <= now_tick)
+    {
+        current_tick_ = tick;
+
+        TimerOpBase* current;
+        if (level == LEVEL_COUNT)
+        {
+            current = std::exchange(overflow_, nullptr);
+        }
+        else
+        {
+            auto& lvl = levels_[level];
+            current = std::exchange(lvl.slots[slot], nullptr);
+            lvl.occupied &= ~(std::uint64_t{1} << slot);
+        }
+
+        // Expired ops fire, the rest cascade down to lower levels
+        while (current != nullptr)
+        {
+            auto next = static_cast<TimerOpBase*>(current->next);
+            current->level = TimerOpBase::NOT_LINKED;
+            insert(current);
+            current = next;
+        }
+    }
+
+    current_tick_ = std::max(current_tick_, now_tick);
+    return tick;
+}
+
+std::uint64_t TimerWheel::to_tick(Clock::time_point tp, bool round_up) const
+{
+    if (tp <= epoch_)
+    {
+        return 0;
+    }
+
+    auto since_epoch = tp - epoch_;
+    auto ticks = round_up
+        ? std::chrono::ceil<Tick>(since_epoch)
+        : std::chrono::floor<Tick>(since_epoch);
+    return static_cast<std::uint64_t>(ticks.count());
+}
+
+TimerWheel::Clock::time_point TimerWheel::to_time_point(std::uint64_t tick) const
+{
+    return epoch_ + Tick{static_cast<Tick::rep>(tick)};
+}
+
+void TimerWheel::cancel_all()
+{
+    // Goes through the same path as a triggered stop token, until nothing is left
+    do
+    {
+        drain_incoming();
+
+        std::lock_guard lock{mtx_};
+        auto claim = [this](TimerOpBase* op)
+            {
+                // Ops that lost the claim are already on the list
+                if (op->claim(TimerOpBase::CANCELLED))
+                {
+                    op->next_cancelled = cancelled_;
+                    cancelled_ = op;
+                }
+            };
+
+        for (auto op = overflow_; op != nullptr; op = static_cast<TimerOpBase*>(op->next))
+        {
+            claim(op);
+        }
+
+        for (auto& lvl : levels_)
+        {
+            for (auto op : lvl.slots)
+            {
+                for (; op != nullptr; op = static_cast<TimerOpBase*>(op->next))
+                {
+                    claim(op);
+                }
+            }
+        }
+    }
+    while (process_cancelled(true));
+}
+
+TimerWheel::~TimerWheel() noexcept
+{
+    thread_.join();
+}
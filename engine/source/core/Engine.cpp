@@ -2,7 +2,6 @@
 
 #include <queue>
 
-#include <cxxopts.hpp>
 #include <unifex/sync_wait.hpp>
 #include <unifex/on.hpp>
 #include <spdlog/spdlog.h>
@@ -11,7 +10,10 @@
 
 #include "concurrency/StaticScope.hpp"
 #include "util/Assert.hpp"
+#include "util/Trace.hpp"
 #include "core/EnginePhases.hpp"
+#include "core/FlecsOsApi.hpp"
+#include "core/FlecsTasks.hpp"
 #include "core/DependencySystem.hpp"
 #include "core/GameplaySystem.hpp"
 #include "core/WindowSystem.hpp"
@@ -27,6 +29,9 @@ EngineBase::EngineBase()
 {
     auto retcode = glfwInit();
     NG_VERIFYF(retcode == GLFW_TRUE, "Unable to initialize GLFW!");
+
+    // The world gets created right after this
+    install_flecs_os_api();
 }
 
 EngineBase::~EngineBase()
@@ -36,21 +41,36 @@ EngineBase::~EngineBase()
 
 Engine::Engine(int argc, char** argv)
     : last_tick_(Clock::now())
+    , config_(EngineConfig::load(APP_NAME, argc, argv))
+    , main_thread_pool_(config_.worker_threads, config_.max_background_tasks, config_.worker_affinities)
+    , blocking_thread_pool_(config_.blocking_threads, config_.max_blocking_threads, config_.blocking_affinities)
 {
-    cxxopts::Options options(APP_NAME, "The hip and cool engine");
-    options.allow_unrecognised_options();
-
-    auto parsed_opts = options.parse(argc, argv);
-
     g_engine = EngineHandle(this);
 
+    if (config_.trace_path.has_value())
+    {
+        if (NG_TRACING)
+        {
+            trace_set_enabled(true);
+        }
+        else
+        {
+            spdlog::warn("Tracing is compiled out of this build, no trace will be written");
+        }
+    }
+
     register_dependency_systems(world_);
     register_gui_systems(world_);
     renderer_ = register_vulkan_systems(world_, APP_NAME);
     register_window_systems(world_);
+    register_transform_systems(world_);
     register_actor_systems(world_);
     input_handler_ = InputHandler::register_input_systems(world_);
 
+    // Multi-threaded systems run their stages as tasks on the main pool
+    install_flecs_task_hooks(main_thread_pool_.get_scheduler(TaskPriority::Critical));
+    world_.set_task_threads(static_cast<std::int32_t>(main_thread_pool_.thread_count()));
+
     asset_subsystem_ = std::make_unique<AssetSubsystem>(AssetSubsystem::CreateInfo{
         .base_path = NG_PROJECT_BASEPATH,
     });
@@ -63,7 +83,8 @@ int Engine::run()
 
 unifex::task<int> Engine::mainEventLoop()
 {
-    co_await unifex::schedule(g_engine.mainScheduler());
+    // Worker 0 owns the reserved CPUs, if there are any
+    co_await g_engine.mainScheduler().schedule_on_thread(0);
 
     
     spdlog::info("Game loop starting");
@@ -78,7 +99,7 @@ unifex::task<int> Engine::mainEventLoop()
 
     bool should_quit = false;
 
-    StaticScope<EngineHandle::MAX_INFLIGHT_FRAMES, unifex::task<void>>
+    StaticScope<EngineHandle::MAX_INFLIGHT_FRAMES, PooledTask<void>>
         rendering_scope(g_engine.inflightFrames());
 
     AssetHandle avocado{"engine/resources/avocado/Avocado.gltf"};
@@ -94,9 +115,9 @@ unifex::task<int> Engine::mainEventLoop()
             co_return;
         };
     
-    global_scope_.spawn(load(avocado));
-    global_scope_.spawn(load(fish));
-    global_scope_.spawn(load(lantern));
+    g_engine.asyncLoad(load(avocado));
+    g_engine.asyncLoad(load(fish));
+    g_engine.asyncLoad(load(lantern));
 
     world_.entity("AVOCADINA")
         .set<CPosition>(CPosition{
@@ -140,43 +161,201 @@ unifex::task<int> Engine::mainEventLoop()
     {
         co_await os_polling_sender_;
 
+        NG_TRACE_ASYNC_ZONE("Frame");
+
+        // Frames keep rendering while we simulate the next ones, so only the ones
+        // that got submitted by now are handled, nothing waits for a submit here
+        if (drainSubmittedFrames())
+        {
+            co_await runFramePhase(FramePhase::AfterRenderSubmit);
+        }
+
         ++current_frame_idx_;
 
-        glfwPollEvents();
+        {
+            NG_TRACE_ZONE("Poll OS events");
+            glfwPollEvents();
+        }
 
-        input_handler_->Update();
+        {
+            NG_TRACE_ZONE("Input");
+            input_handler_->Update();
+        }
 
         auto this_tick = Clock::now();
         float delta_seconds =
             std::chrono::duration_cast<std::chrono::duration<float, std::ratio<1, 1>>>(this_tick - last_tick_).count();
         last_tick_ = this_tick;
 
-        FramePacket packet;
+        FramePacket packet{leaseFrameArena()};
+        packet.static_meshes.resize(world_.get_stage_count());
 
         world_.component<CCurrentFramePacket>()
             .set(CCurrentFramePacket{&packet});
 
-        next_frame_events_.executeAll();
+        co_await runFramePhase(FramePhase::BeforeSimulation);
 
-        should_quit |= !world_.progress(delta_seconds);
+        {
+            NG_TRACE_ZONE("Simulation");
+            should_quit |= !world_.progress(delta_seconds);
+        }
+
+        co_await runFramePhase(FramePhase::AfterSimulation);
 
         world_.component<CCurrentFramePacket>()
             .set(CCurrentFramePacket{nullptr});
 
 
 
-        co_await rendering_scope.spawn_next(renderer_->renderFrame(current_frame_idx_, std::move(packet)));
+        {
+            // Waits for a free inflight frame slot
+            NG_TRACE_ASYNC_ZONE("Render spawn");
+            co_await rendering_scope.spawn_next(
+                renderer_->renderFrame(current_frame_idx_, std::move(packet), frame_submitted_));
+        }
+
+        if (config_.scheduler_stats_interval != 0
+            && current_frame_idx_ % config_.scheduler_stats_interval == 0)
+        {
+            logSchedulerStats();
+        }
+
+        co_await runFramePhase(FramePhase::EndOfFrame);
     }
 
     co_await rendering_scope.all_finished();
+    co_await os_polling_sender_;
+    if (drainSubmittedFrames())
+    {
+        co_await runFramePhase(FramePhase::AfterRenderSubmit);
+    }
+
+    co_await unifex::on(g_engine.mainScheduler(), load_scope_.cleanup());
     co_await unifex::on(g_engine.mainScheduler(), global_scope_.cleanup());
 
     run_all(query_for_tag<TGameLoopFinished>(world_));
     
+    timer_wheel_.request_stop();
+    io_scheduler_.request_stop();
     main_thread_pool_.request_stop();
     blocking_thread_pool_.request_stop();
 
+    if (config_.trace_path.has_value())
+    {
+        trace_set_enabled(false);
+        write_chrome_trace(config_.trace_path.value());
+    }
+
     spdlog::info("Game loop finished successfully");
 
     co_return 0;
 }
+
+FrameArena::Lease Engine::leaseFrameArena()
+{
+    // Packets of finished frames are destroyed before their scope slot frees up,
+    // so at most inflightFrames() arenas are in use here
+    auto count = inflight_frames_ + 1;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        auto lease = frame_arenas_[(current_frame_idx_ + i) % count].try_lease();
+        if (lease)
+        {
+            return lease;
+        }
+    }
+
+    NG_PANIC("All frame arenas are in use!");
+}
+
+bool Engine::drainSubmittedFrames()
+{
+    bool any = false;
+    while (frame_submitted_.try_acquire())
+    {
+        any = true;
+    }
+    return any;
+}
+
+PooledTask<void> Engine::runFramePhase(FramePhase phase)
+{
+    // Trace names have to be string literals
+    static constexpr std::array<const char*, FRAME_PHASE_COUNT> PHASE_NAMES{
+        "BeforeSimulation events",
+        "AfterSimulation events",
+        "AfterRenderSubmit events",
+        "EndOfFrame events",
+    };
+    NG_TRACE_ASYNC_ZONE(PHASE_NAMES[static_cast<std::size_t>(phase)]);
+
+    auto& events = frame_events_[static_cast<std::size_t>(phase)];
+
+    events.executeSerial();
+
+    if (events.hasConcurrent())
+    {
+        co_await events.executeConcurrent(main_thread_pool_.get_scheduler(TaskPriority::Critical));
+        // The rest of the frame has to happen on the OS thread
+        co_await os_polling_sender_;
+    }
+}
+
+void Engine::logSchedulerStats()
+{
+    using std::chrono::duration_cast;
+    using std::chrono::milliseconds;
+    using Microseconds = std::chrono::duration<double, std::micro>;
+
+    auto now = Clock::now();
+    auto elapsed = duration_cast<milliseconds>(now - last_stats_time_);
+    last_stats_time_ = now;
+
+    auto log_pool = [elapsed](const char* name, const PoolStats& current, PoolStats& last)
+        {
+            last.workers.resize(current.workers.size());
+
+            for (std::size_t i = 0; i < current.workers.size(); ++i)
+            {
+                auto delta = current.workers[i];
+                delta -= last.workers[i];
+                spdlog::debug("{} worker {}: {} tasks ({} stolen, {} pinned), parked {} times for {}ms",
+                    name, i, delta.tasks_run, delta.tasks_stolen, delta.pinned_tasks,
+                    delta.parks, duration_cast<milliseconds>(delta.parked_time).count());
+            }
+
+            auto total = current.total();
+            total -= last.total();
+            auto locks = current.queue_locks;
+            locks -= last.queue_locks;
+            spdlog::info("{} pool over {}ms: {} tasks ({} stolen, {} pinned, {} unpinned), {} queued, "
+                "parked {} times for {}ms, wake latency p50 <{:.1f}us p99 <{:.1f}us, "
+                "queue locks contended {} times ({} parked)",
+                name, elapsed.count(), total.tasks_run, total.tasks_stolen, total.pinned_tasks,
+                total.unpinned_tasks(), current.queued_tasks, total.parks,
+                duration_cast<milliseconds>(total.parked_time).count(),
+                Microseconds{total.wake_latency.percentile(0.5)}.count(),
+                Microseconds{total.wake_latency.percentile(0.99)}.count(),
+                locks.contended, locks.parked);
+
+            last = current;
+        };
+
+    log_pool("Main", main_thread_pool_.stats(), last_main_stats_);
+    log_pool("Blocking", blocking_thread_pool_.stats(), last_blocking_stats_);
+
+    auto ecs_memory = flecs_memory_stats();
+    auto ecs_delta = ecs_memory;
+    ecs_delta -= last_ecs_memory_;
+    last_ecs_memory_ = ecs_memory;
+    spdlog::info("ECS memory over {}ms: {} allocations ({} bytes), {} frees ({} bytes), {} bytes live",
+        elapsed.count(), ecs_delta.allocations, ecs_delta.bytes_allocated,
+        ecs_delta.frees, ecs_delta.bytes_freed, ecs_memory.live_bytes());
+
+    for (std::size_t i = 0; i < FRAME_PHASE_COUNT; ++i)
+    {
+        auto stats = frame_events_[i].stats();
+        spdlog::info("Frame phase {}: {} serial and {} concurrent events last frame",
+            i, stats.last_serial_batch, stats.last_concurrent_batch);
+    }
+}
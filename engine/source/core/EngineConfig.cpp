@@ -0,0 +1,255 @@
+#include "core/EngineConfig.hpp"
+
+#include <algorithm>
+#include <string>
+
+#include <cxxopts.hpp>
+#include <spdlog/spdlog.h>
+#include <yaml-cpp/yaml.h>
+
+
+namespace
+{
+
+WorkerAffinity parse_affinity(const std::string& name)
+{
+    if (name == "none")
+    {
+        return WorkerAffinity::None;
+    }
+    else if (name == "cores")
+    {
+        return WorkerAffinity::Cores;
+    }
+    else if (name == "numa")
+    {
+        return WorkerAffinity::Numa;
+    }
+
+    throw std::runtime_error("Unknown affinity mode: " + name);
+}
+
+// Spreads count threads over the CPUs according to the affinity mode
+std::vector<CpuSet> distribute(WorkerAffinity affinity, const CpuSet& cpus,
+    const std::vector<CpuSet>& nodes, std::size_t count, bool restricted)
+{
+    std::vector<CpuSet> result;
+    result.reserve(count);
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        switch (affinity)
+        {
+        case WorkerAffinity::Cores:
+            result.push_back(CpuSet{cpus[i % cpus.size()]});
+            break;
+        case WorkerAffinity::Numa:
+            result.push_back(nodes[i % nodes.size()]);
+            break;
+        case WorkerAffinity::None:
+            result.push_back(restricted ? cpus : CpuSet{});
+            break;
+        }
+    }
+
+    return result;
+}
+
+}
+
+EngineConfig EngineConfig::load(std::string_view app_name, int argc, char** argv)
+{
+    cxxopts::Options options(std::string{app_name}, "The hip and cool engine");
+    options.allow_unrecognised_options();
+    options.add_options()
+        ("config", "Path to the engine config",
+            cxxopts::value<std::string>()->default_value(NG_PROJECT_BASEPATH"/engine/resources/config/engine.yaml"))
+        ("worker-threads", "Amount of main worker threads, 0 for auto", cxxopts::value<std::size_t>())
+        ("blocking-threads", "Minimal amount of blocking worker threads, 0 for auto", cxxopts::value<std::size_t>())
+        ("max-blocking-threads", "Maximal amount of blocking worker threads, 0 for auto", cxxopts::value<std::size_t>())
+        ("max-concurrent-loads", "Amount of asset loads running at the same time", cxxopts::value<std::size_t>())
+        ("affinity", "Worker pinning: none, cores or numa", cxxopts::value<std::string>())
+        ("numa-node", "Only run on this NUMA node, -1 for all of them", cxxopts::value<int>())
+        ("reserved-cpus", "CPUs dedicated to the OS polling worker", cxxopts::value<std::vector<std::size_t>>())
+        ("scheduler-stats", "Log scheduler counters every this many frames, 0 to disable", cxxopts::value<std::size_t>())
+        ("trace", "Record a Chrome trace and write it to this file on exit", cxxopts::value<std::string>());
+
+    auto parsed_opts = options.parse(argc, argv);
+
+    EngineConfig result;
+    result.config_path = parsed_opts["config"].as<std::string>();
+
+    if (std::filesystem::exists(result.config_path))
+    {
+        result.loadFile(result.config_path);
+    }
+    else
+    {
+        spdlog::warn("Engine config {} not found, using defaults", result.config_path.string());
+    }
+
+    if (parsed_opts.count("worker-threads"))
+    {
+        result.worker_threads = parsed_opts["worker-threads"].as<std::size_t>();
+    }
+    if (parsed_opts.count("blocking-threads"))
+    {
+        result.blocking_threads = parsed_opts["blocking-threads"].as<std::size_t>();
+    }
+    if (parsed_opts.count("max-blocking-threads"))
+    {
+        result.max_blocking_threads = parsed_opts["max-blocking-threads"].as<std::size_t>();
+    }
+    if (parsed_opts.count("max-concurrent-loads"))
+    {
+        result.max_concurrent_loads = parsed_opts["max-concurrent-loads"].as<std::size_t>();
+    }
+    if (parsed_opts.count("affinity"))
+    {
+        result.affinity = parse_affinity(parsed_opts["affinity"].as<std::string>());
+    }
+    if (parsed_opts.count("numa-node"))
+    {
+        auto node = parsed_opts["numa-node"].as<int>();
+        result.numa_node = node < 0 ? std::nullopt : std::optional{static_cast<std::size_t>(node)};
+    }
+    if (parsed_opts.count("reserved-cpus"))
+    {
+        result.reserved_cpus = parsed_opts["reserved-cpus"].as<std::vector<std::size_t>>();
+    }
+    if (parsed_opts.count("scheduler-stats"))
+    {
+        result.scheduler_stats_interval = parsed_opts["scheduler-stats"].as<std::size_t>();
+    }
+    if (parsed_opts.count("trace"))
+    {
+        result.trace_path = parsed_opts["trace"].as<std::string>();
+    }
+
+    result.resolveTopology();
+
+    return result;
+}
+
+void EngineConfig::loadFile(const std::filesystem::path& path)
+{
+    YAML::Node doc = YAML::LoadFile(path.string());
+
+    if (auto threads = doc["threads"])
+    {
+        worker_threads = threads["workers"].as<std::size_t>(worker_threads);
+        blocking_threads = threads["blocking"].as<std::size_t>(blocking_threads);
+        max_blocking_threads = threads["max_blocking"].as<std::size_t>(max_blocking_threads);
+        max_background_tasks = threads["max_background_tasks"].as<std::size_t>(max_background_tasks);
+    }
+
+    if (auto assets = doc["assets"])
+    {
+        max_concurrent_loads = assets["max_concurrent_loads"].as<std::size_t>(max_concurrent_loads);
+    }
+
+    if (auto placement = doc["affinity"])
+    {
+        if (auto mode = placement["mode"])
+        {
+            affinity = parse_affinity(mode.as<std::string>());
+        }
+
+        auto node = placement["numa_node"].as<int>(-1);
+        numa_node = node < 0 ? std::nullopt : std::optional{static_cast<std::size_t>(node)};
+
+        reserved_cpus = placement["reserved_cpus"].as<std::vector<std::size_t>>(reserved_cpus);
+    }
+
+    if (auto stats = doc["stats"])
+    {
+        scheduler_stats_interval = stats["scheduler_interval"].as<std::size_t>(scheduler_stats_interval);
+
+        if (auto trace = stats["trace"].as<std::string>(""); !trace.empty())
+        {
+            trace_path = trace;
+        }
+    }
+}
+
+void EngineConfig::resolveTopology()
+{
+    auto available = process_cpus();
+
+    std::sort(reserved_cpus.begin(), reserved_cpus.end());
+    reserved_cpus = cpu_set_intersection(reserved_cpus, available);
+
+    auto nodes = numa_nodes();
+    if (numa_node.has_value())
+    {
+        auto node = std::find_if(nodes.begin(), nodes.end(),
+            [this](const NumaNode& n) { return n.id == numa_node.value(); });
+        if (node != nodes.end())
+        {
+            available = cpu_set_intersection(available, node->cpus);
+        }
+        else
+        {
+            spdlog::warn("NUMA node {} does not exist or has no CPUs, ignoring", numa_node.value());
+            numa_node.reset();
+        }
+    }
+
+    auto general = cpu_set_difference(available, reserved_cpus);
+    if (general.empty())
+    {
+        spdlog::warn("All CPUs are reserved, ignoring the reservation");
+        reserved_cpus.clear();
+        general = available;
+    }
+
+    // Only keep the nodes we can actually run on
+    std::vector<CpuSet> general_nodes;
+    for (auto& node : nodes)
+    {
+        if (auto cpus = cpu_set_intersection(node.cpus, general); !cpus.empty())
+        {
+            general_nodes.push_back(std::move(cpus));
+        }
+    }
+
+    // The OS polling worker sits on the reserved CPUs on its own
+    std::size_t dedicated = reserved_cpus.empty() ? 0 : 1;
+
+    if (worker_threads == 0)
+    {
+        worker_threads = general.size() + dedicated;
+    }
+    worker_threads = std::max(worker_threads, dedicated + 1);
+
+    if (blocking_threads == 0)
+    {
+        blocking_threads = std::max<std::size_t>(1, general.size() / 4);
+    }
+    if (max_blocking_threads == 0)
+    {
+        // Stuck threads don't use any CPU, so we can afford more of them than cores
+        max_blocking_threads = 2 * general.size();
+    }
+    max_blocking_threads = std::max(max_blocking_threads, blocking_threads);
+    max_concurrent_loads = std::max<std::size_t>(max_concurrent_loads, 1);
+
+    // Don't pin anything unless asked to
+    bool restricted = dedicated != 0 || numa_node.has_value();
+
+    worker_affinities.clear();
+    if (dedicated != 0)
+    {
+        worker_affinities.push_back(reserved_cpus);
+    }
+    auto workers = distribute(affinity, general, general_nodes, worker_threads - dedicated, restricted);
+    worker_affinities.insert(worker_affinities.end(), workers.begin(), workers.end());
+
+    // Blocking threads mostly sleep, so pinning them to single cores makes no sense
+    blocking_affinities = distribute(
+        affinity == WorkerAffinity::Cores ? WorkerAffinity::None : affinity,
+        general, general_nodes, max_blocking_threads, restricted || affinity == WorkerAffinity::Cores);
+
+    spdlog::info("Using {} workers and {} to {} blocking workers",
+        worker_threads, blocking_threads, max_blocking_threads);
+}
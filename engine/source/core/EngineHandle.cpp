@@ -8,9 +8,9 @@ ThreadPool::Scheduler::Sender EngineHandle::scheduleOsPolling()
     return engine_->os_polling_sender_;
 }
 
-ThreadPool::Scheduler EngineHandle::mainScheduler()
+ThreadPool::Scheduler EngineHandle::mainScheduler(TaskPriority priority)
 {
-    return engine_->main_thread_pool_.get_scheduler();
+    return engine_->main_thread_pool_.get_scheduler(priority);
 }
 
 BlockingThreadPool::Scheduler EngineHandle::blockingScheduler()
@@ -18,9 +18,39 @@ BlockingThreadPool::Scheduler EngineHandle::blockingScheduler()
     return engine_->blocking_thread_pool_.get_scheduler();
 }
 
+EventQueue::Scheduler EngineHandle::frameScheduler(FramePhase phase, bool thread_safe)
+{
+    return engine_->frame_events_[static_cast<std::size_t>(phase)].get_scheduler(thread_safe);
+}
+
 EventQueue::Scheduler EngineHandle::nextFrameScheduler()
 {
-    return engine_->next_frame_events_.get_scheduler();
+    return frameScheduler(FramePhase::BeforeSimulation);
+}
+
+TimerWheel::Scheduler EngineHandle::timerScheduler()
+{
+    return engine_->timer_wheel_.get_scheduler();
+}
+
+IoScheduler& EngineHandle::io()
+{
+    return engine_->io_scheduler_;
+}
+
+PoolStats EngineHandle::mainPoolStats()
+{
+    return engine_->main_thread_pool_.stats();
+}
+
+PoolStats EngineHandle::blockingPoolStats()
+{
+    return engine_->blocking_thread_pool_.stats();
+}
+
+EventQueueStats EngineHandle::frameEventStats(FramePhase phase)
+{
+    return engine_->frame_events_[static_cast<std::size_t>(phase)].stats();
 }
 
 void EngineHandle::async(unifex::any_sender_of<> task)
@@ -28,6 +58,11 @@ void EngineHandle::async(unifex::any_sender_of<> task)
     engine_->global_scope_.spawn(std::move(task));
 }
 
+void EngineHandle::asyncLoad(unifex::any_sender_of<> task)
+{
+    engine_->load_scope_.spawn(std::move(task));
+}
+
 flecs::world& EngineHandle::world()
 {
     return engine_->world_;
@@ -0,0 +1,202 @@
+#include "core/FlecsOsApi.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <thread>
+#include <flecs.h>
+
+#include "concurrency/AdaptiveMutex.hpp"
+#include "concurrency/FrameAllocator.hpp"
+#include "util/Assert.hpp"
+
+
+namespace
+{
+
+MemoryCounters g_flecs_memory;
+
+// flecs doesn't pass the size to free, so every block starts with it
+struct alignas(std::max_align_t) BlockHeader
+{
+    std::size_t size;
+};
+
+std::size_t block_size(std::size_t size)
+{
+    return sizeof(BlockHeader) + size;
+}
+
+BlockHeader* header_of(void* ptr)
+{
+    return static_cast<BlockHeader*>(ptr) - 1;
+}
+
+void* os_malloc(ecs_size_t size)
+{
+    NG_ASSERT(size >= 0);
+    auto bytes = static_cast<std::size_t>(size);
+
+    auto header = static_cast<BlockHeader*>(FrameAllocator::allocate(block_size(bytes)));
+    header->size = bytes;
+    g_flecs_memory.allocated(bytes);
+    return header + 1;
+}
+
+void* os_calloc(ecs_size_t size)
+{
+    auto ptr = os_malloc(size);
+    std::memset(ptr, 0, static_cast<std::size_t>(size));
+    return ptr;
+}
+
+void os_free(void* ptr)
+{
+    if (ptr == nullptr)
+    {
+        return;
+    }
+
+    auto header = header_of(ptr);
+    g_flecs_memory.freed(header->size);
+    FrameAllocator::deallocate(header, block_size(header->size));
+}
+
+void* os_realloc(void* ptr, ecs_size_t size)
+{
+    if (ptr == nullptr)
+    {
+        return os_malloc(size);
+    }
+
+    NG_ASSERT(size >= 0);
+    auto bytes = static_cast<std::size_t>(size);
+    auto header = header_of(ptr);
+    auto old_bytes = header->size;
+
+    // Vectors growing a few elements at a time usually stay in their size class
+    if (FrameAllocator::usable_size(block_size(bytes)) == FrameAllocator::usable_size(block_size(old_bytes)))
+    {
+        header->size = bytes;
+        g_flecs_memory.resized(old_bytes, bytes);
+        return ptr;
+    }
+
+    auto result = os_malloc(size);
+    std::memcpy(result, ptr, std::min(bytes, old_bytes));
+    os_free(ptr);
+    return result;
+}
+
+AdaptiveMutex* as_mutex(ecs_os_mutex_t mutex)
+{
+    return reinterpret_cast<AdaptiveMutex*>(mutex);
+}
+
+ecs_os_mutex_t os_mutex_new()
+{
+    return reinterpret_cast<ecs_os_mutex_t>(new AdaptiveMutex);
+}
+
+void os_mutex_free(ecs_os_mutex_t mutex)
+{
+    delete as_mutex(mutex);
+}
+
+void os_mutex_lock(ecs_os_mutex_t mutex)
+{
+    as_mutex(mutex)->lock();
+}
+
+void os_mutex_unlock(ecs_os_mutex_t mutex)
+{
+    as_mutex(mutex)->unlock();
+}
+
+std::condition_variable_any* as_cond(ecs_os_cond_t cond)
+{
+    return reinterpret_cast<std::condition_variable_any*>(cond);
+}
+
+ecs_os_cond_t os_cond_new()
+{
+    return reinterpret_cast<ecs_os_cond_t>(new std::condition_variable_any);
+}
+
+void os_cond_free(ecs_os_cond_t cond)
+{
+    delete as_cond(cond);
+}
+
+void os_cond_signal(ecs_os_cond_t cond)
+{
+    as_cond(cond)->notify_one();
+}
+
+void os_cond_broadcast(ecs_os_cond_t cond)
+{
+    as_cond(cond)->notify_all();
+}
+
+void os_cond_wait(ecs_os_cond_t cond, ecs_os_mutex_t mutex)
+{
+    as_cond(cond)->wait(*as_mutex(mutex));
+}
+
+std::uint64_t os_now()
+{
+    using namespace std::chrono;
+    return static_cast<std::uint64_t>(
+        duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count());
+}
+
+void os_get_time(ecs_time_t* time)
+{
+    constexpr std::uint64_t NS_PER_SECOND = 1'000'000'000;
+    auto now = os_now();
+    time->sec = static_cast<std::uint32_t>(now / NS_PER_SECOND);
+    time->nanosec = static_cast<std::uint32_t>(now % NS_PER_SECOND);
+}
+
+void os_sleep(std::int32_t sec, std::int32_t nanosec)
+{
+    std::this_thread::sleep_for(std::chrono::seconds{sec} + std::chrono::nanoseconds{nanosec});
+}
+
+}
+
+void install_flecs_os_api()
+{
+    ecs_os_set_api_defaults();
+
+    ecs_os_api_t api = ecs_os_api;
+
+    api.malloc_ = &os_malloc;
+    api.calloc_ = &os_calloc;
+    api.realloc_ = &os_realloc;
+    api.free_ = &os_free;
+
+    api.mutex_new_ = &os_mutex_new;
+    api.mutex_free_ = &os_mutex_free;
+    api.mutex_lock_ = &os_mutex_lock;
+    api.mutex_unlock_ = &os_mutex_unlock;
+
+    api.cond_new_ = &os_cond_new;
+    api.cond_free_ = &os_cond_free;
+    api.cond_signal_ = &os_cond_signal;
+    api.cond_broadcast_ = &os_cond_broadcast;
+    api.cond_wait_ = &os_cond_wait;
+
+    api.now_ = &os_now;
+    api.get_time_ = &os_get_time;
+    api.sleep_ = &os_sleep;
+
+    ecs_os_set_api(&api);
+}
+
+MemoryStats flecs_memory_stats()
+{
+    return g_flecs_memory.snapshot();
+}
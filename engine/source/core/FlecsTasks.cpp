@@ -0,0 +1,146 @@
+#include "core/FlecsTasks.hpp"
+
+#include <atomic>
+#include <exception>
+#include <optional>
+#include <flecs.h>
+#include <unifex/manual_lifetime.hpp>
+
+#include "util/Assert.hpp"
+#include "util/Trace.hpp"
+
+
+namespace
+{
+
+std::optional<ThreadPool::Scheduler> g_flecs_scheduler;
+
+// A stage of a flecs worker, run either by the pool or by whoever joins it first
+class FlecsTask
+{
+    struct Receiver
+    {
+        void set_value() && noexcept
+        {
+            task->try_run();
+            task->release();
+        }
+
+        // The pool is stopping, the joining thread will run it
+        void set_done() && noexcept
+        {
+            task->release();
+        }
+
+        void set_error(std::exception_ptr) && noexcept
+        {
+            std::terminate();
+        }
+
+        FlecsTask* task;
+    };
+
+    using Op = unifex::connect_result_t<ThreadPool::Scheduler::Sender, Receiver>;
+
+    enum State : int
+    {
+        QUEUED,
+        RUNNING,
+        DONE,
+    };
+
+public:
+    FlecsTask(ecs_os_thread_callback_t callback, void* arg)
+        : callback_{callback}
+        , arg_{arg}
+    {
+    }
+
+    void start(ThreadPool::Scheduler scheduler)
+    {
+        op_.construct_with([this, scheduler]()
+            {
+                return unifex::connect(scheduler.schedule(), Receiver{this});
+            });
+        unifex::start(op_.get());
+    }
+
+    void* join()
+    {
+        // Running it here instead of sleeping keeps a joining worker useful,
+        // and nothing deadlocks if every other worker is busy
+        if (!try_run())
+        {
+            for (auto state = state_.load(std::memory_order::acquire);
+                state != DONE;
+                state = state_.load(std::memory_order::acquire))
+            {
+                state_.wait(state, std::memory_order::acquire);
+            }
+        }
+
+        auto result = result_;
+        release();
+        return result;
+    }
+
+private:
+    bool try_run()
+    {
+        int expected = QUEUED;
+        if (!state_.compare_exchange_strong(expected, RUNNING, std::memory_order::acquire))
+        {
+            return false;
+        }
+
+        {
+            NG_TRACE_ZONE("Flecs stage");
+            result_ = callback_(arg_);
+        }
+        state_.store(DONE, std::memory_order::release);
+        state_.notify_all();
+        return true;
+    }
+
+    // Both the pool and the joiner hold a reference
+    void release()
+    {
+        if (refs_.fetch_sub(1, std::memory_order::acq_rel) == 1)
+        {
+            op_.destruct();
+            delete this;
+        }
+    }
+
+private:
+    ecs_os_thread_callback_t callback_;
+    void* arg_;
+    void* result_{nullptr};
+    std::atomic<int> state_{QUEUED};
+    std::atomic<int> refs_{2};
+    unifex::manual_lifetime<Op> op_;
+};
+
+ecs_os_thread_t flecs_task_new(ecs_os_thread_callback_t callback, void* arg)
+{
+    auto task = new FlecsTask(callback, arg);
+    task->start(*g_flecs_scheduler);
+    return reinterpret_cast<ecs_os_thread_t>(task);
+}
+
+void* flecs_task_join(ecs_os_thread_t thread)
+{
+    return reinterpret_cast<FlecsTask*>(thread)->join();
+}
+
+}
+
+void install_flecs_task_hooks(ThreadPool::Scheduler scheduler)
+{
+    g_flecs_scheduler = scheduler;
+
+    // The OS API is already initialized by the world, only the task hooks are swapped
+    ecs_os_api.task_new_ = &flecs_task_new;
+    ecs_os_api.task_join_ = &flecs_task_join;
+    NG_ASSERT(ecs_os_has_task_support());
+}
@@ -0,0 +1,94 @@
+#include "core/GameplaySystem.hpp"
+
+#include <vector>
+
+#include "rendering/TransformKernels.hpp"
+
+
+namespace
+{
+
+// Dirty rows of a table, gathered so that they go through the batch kernels at once.
+// Reused between tables and frames, so it only allocates while the scene grows.
+struct TransformScratch
+{
+	std::vector<std::size_t> rows;
+	std::vector<glm::vec3> positions;
+	std::vector<glm::quat> rotations;
+	std::vector<glm::vec3> scales;
+	std::vector<glm::mat4> matrices;
+
+	void clear()
+	{
+		rows.clear();
+		positions.clear();
+		rotations.clear();
+		scales.clear();
+	}
+};
+
+}
+
+void register_transform_systems(flecs::world& world)
+{
+	// Every positioned entity gets a world transform, so that other systems can rely on it
+	world.component<CPosition>().add(flecs::With, world.component<CWorldTransform>());
+
+	// Cascade walks the hierarchy breadth first, so parents are always done before their children.
+	// Only entities that moved themselves, or whose parent got recomputed, are touched.
+	world.system<CPosition, CWorldTransform, const CWorldTransform>("Update world transforms")
+		.term_at(3).parent().cascade().optional()
+		.kind(flecs::OnValidate)
+		.iter([](flecs::iter it, CPosition* position, CWorldTransform* transform, const CWorldTransform* parent)
+		{
+			thread_local TransformScratch scratch;
+			scratch.clear();
+
+			// ChildOf is part of the archetype, so everything in a table shares the parent
+			flecs::entity_t parent_id = parent != nullptr ? it.src(3).id() : 0;
+			std::uint32_t parent_version = parent != nullptr ? parent->version : 0;
+
+			for (auto i : it)
+			{
+				auto& cached = transform[i];
+				if (!position[i].dirty
+					&& cached.parent == parent_id
+					&& cached.parent_version == parent_version)
+				{
+					continue;
+				}
+
+				scratch.rows.push_back(i);
+				scratch.positions.push_back(position[i].position);
+				scratch.rotations.push_back(position[i].rotation);
+				scratch.scales.push_back(position[i].scale);
+			}
+
+			if (scratch.rows.empty())
+			{
+				return;
+			}
+
+			scratch.matrices.resize(scratch.rows.size());
+			compose_trs(scratch.positions, scratch.rotations, scratch.scales, scratch.matrices);
+			if (parent != nullptr)
+			{
+				multiply_matrices(parent->matrix, scratch.matrices, scratch.matrices);
+			}
+
+			bool parent_uniform = parent == nullptr || parent->uniform_scale;
+			for (std::size_t j = 0; j < scratch.rows.size(); ++j)
+			{
+				auto i = scratch.rows[j];
+				auto& cached = transform[i];
+				auto& s = scratch.scales[j];
+
+				cached.matrix = scratch.matrices[j];
+				cached.uniform_scale = parent_uniform && s.x == s.y && s.y == s.z;
+				cached.parent = parent_id;
+				cached.parent_version = parent_version;
+				++cached.version;
+				position[i].dirty = false;
+			}
+		});
+}
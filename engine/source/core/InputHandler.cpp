@@ -18,22 +18,27 @@ std::unique_ptr<InputHandler> InputHandler::register_input_systems(flecs::world
         .arg(2).obj(world.entity("InputAxis_MoveForward_State"))
         .each([](flecs::entity e, CPosition& pos, InputAxisState& axis) {
             pos.position += pos.rotation * glm::vec3(0, 0, -1) * e.delta_time() * (float)axis.value;
+            pos.dirty = true;
         });
     world.system<CPosition>()
         .term(world.entity("InputAction_MoveLeft_Active"))
         .each([](flecs::entity e, CPosition& pos) {
             pos.position -= pos.rotation * glm::vec3(1, 0, 0) * e.delta_time();
+            pos.dirty = true;
         });
     world.system<CPosition, InputActionState>()
         .arg(2).obj(world.entity("InputAction_MoveRight_State"))
         .each([](flecs::entity e, CPosition& pos, InputActionState& state) {
-            if (state.active)
+            if (state.active) {
                 pos.position += pos.rotation * glm::vec3(1, 0, 0) * e.delta_time();
+                pos.dirty = true;
+            }
         });
     world.system<CPosition, InputAxisState>()
         .arg(2).obj(world.entity("InputAxis_MoveUp_State"))
         .each([](flecs::entity e, CPosition& pos, InputAxisState& axis) {
             pos.position += pos.rotation * glm::vec3(0, 1, 0) * e.delta_time() * (float)axis.value;
+            pos.dirty = true;
         });
     world.system<CPosition>()
         .term<InputAxisState>(world.entity("InputAxis_CameraX_State"))
@@ -47,6 +52,7 @@ std::unique_ptr<InputHandler> InputHandler::register_input_systems(flecs::world
                 glm::quat yaw = glm::angleAxis(glm::radians(x[i].value), glm::dvec3{0., -1., 0.});
                 glm::quat pitch = glm::angleAxis(glm::radians(y[i].value), glm::dvec3{-1., 0., 0.});
                 pos[i].rotation = yaw * pos[i].rotation * pitch;
+                pos[i].dirty = true;
             }
         });
 
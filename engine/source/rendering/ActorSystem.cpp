@@ -10,34 +10,34 @@
 
 void register_actor_systems(flecs::world& world)
 {
-    world.system<CStaticMeshActor, CPosition>("Send static meshes to rendering")
+    world.system<const CStaticMeshActor, const CWorldTransform>("Send static meshes to rendering")
 		.kind(flecs::PostUpdate)
-		.iter([](flecs::iter it, const CStaticMeshActor* actor, const CPosition* position)
+		.multi_threaded()
+		.iter([](flecs::iter it, const CStaticMeshActor* actor, const CWorldTransform* transform)
 		{
-			FramePacket* packet =
-				it.world().component<CCurrentFramePacket>().get<CCurrentFramePacket>()->packet;
+			// Runs on several stages at once, each one only touches its own list
+			FramePacket* packet = it.world().get<CCurrentFramePacket>()->packet;
 			NG_ASSERT(packet != nullptr);
+			NG_ASSERT(static_cast<std::size_t>(it.world().get_stage_id()) < packet->static_meshes.size());
+
+			auto& meshes = packet->static_meshes[it.world().get_stage_id()];
 
 			auto id = glm::identity<glm::mat4>();
 
 			for (auto i : it)
 			{
-				auto mat =
-					translate(id, position[i].position)
-					* scale(id, glm::vec3(actor[i].scale))
-					* mat4_cast(position[i].rotation);
-
-				packet->static_meshes.emplace_back(StaticMeshPacket{
-					.transform = mat,
+				meshes.emplace_back(StaticMeshPacket{
+					.transform = transform[i].matrix * scale(id, glm::vec3(actor[i].scale)),
 					.model = actor[i].model,
+					.uniform_scale = transform[i].uniform_scale,
 				});
 			}
 		});
 
-    world.system<CCameraActor, CPosition>("Send camera to rendering")
+    world.system<const CCameraActor, const CWorldTransform>("Send camera to rendering")
 		.kind(flecs::PostUpdate)
 		.term<TActiveCamera>()
-		.iter([](flecs::iter it, const CCameraActor* actor, const CPosition* position)
+		.iter([](flecs::iter it, const CCameraActor* actor, const CWorldTransform* transform)
 		{
 			FramePacket* packet =
 				it.world().component<CCurrentFramePacket>().get<CCurrentFramePacket>()->packet;
@@ -45,9 +45,7 @@ void register_actor_systems(flecs::world& world)
 
 			auto i = *it.begin();
 
-			packet->view = inverse(
-				translate(glm::identity<glm::mat4>(), position[i].position)
-				* mat4_cast(position[i].rotation));
+			packet->view = inverse(transform[i].matrix);
 			packet->fov = actor[i].fov; 
 			packet->near = actor[i].near;
 			packet->far = actor[i].far;
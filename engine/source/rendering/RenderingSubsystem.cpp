@@ -1,6 +1,7 @@
 #include "rendering/RenderingSubsystem.hpp"
 
 #include <unordered_set>
+#include <utility>
 
 #include <spdlog/spdlog.h>
 #include <unifex/just.hpp>
@@ -10,6 +11,7 @@
 #include "core/EngineHandle.hpp"
 #include "util/DebugBreak.hpp"
 #include "util/Defer.hpp"
+#include "util/Trace.hpp"
 
 
 constexpr std::array DEVICE_EXTENSIONS {
@@ -210,6 +212,30 @@ unifex::task<void> RenderingSubsystem::makeVkWindow(vk::UniqueSurfaceKHR surface
     co_return;
 }
 
+void RenderingSubsystem::rebuildPrepareGraph(std::size_t window_count)
+{
+    prepare_graph_ = std::make_unique<TaskGraph>(g_engine.mainScheduler(TaskPriority::Critical));
+
+    prepare_graph_->add_async("Record uploads", [this]() { return recordUploads(); });
+    for (std::size_t i = 0; i < window_count; ++i)
+    {
+        prepare_graph_->add_async("Acquire swapchain image", [this, i]() { return acquireImage(i); });
+    }
+}
+
+PooledTask<void> RenderingSubsystem::acquireImage(std::size_t window)
+{
+    prep_.images[window] = co_await prep_.windows[window]->acquireNext(prep_.frame_index);
+}
+
+PooledTask<void> RenderingSubsystem::recordUploads()
+{
+    auto cb = prep_.upload_cb;
+    cb.begin(vk::CommandBufferBeginInfo{.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+    prep_.uploads = co_await gpu_storage_manager_->frameUpload(cb);
+    cb.end();
+}
+
 VkBool32 RenderingSubsystem::debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
                                            VkDebugUtilsMessageTypeFlagsEXT messageType, const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData,
                                            void* pUserData)
@@ -237,8 +263,22 @@ VkBool32 RenderingSubsystem::debugCallback(VkDebugUtilsMessageSeverityFlagBitsEX
     return VK_FALSE;
 }
 
-unifex::task<void> RenderingSubsystem::renderFrame(std::size_t frame_index, FramePacket packet)
+PooledTask<void> RenderingSubsystem::renderFrame(std::size_t frame_index, FramePacket packet,
+    AsyncSemaphore& submitted)
 {
+    NG_TRACE_ASYNC_ZONE("RenderingSubsystem::renderFrame");
+
+    // The main loop counts these, so it has to happen even if we bail out early
+    bool submit_signaled = false;
+    auto signal_submitted = [&submitted, &submit_signaled]()
+        {
+            if (!std::exchange(submit_signaled, true))
+            {
+                submitted.release();
+            }
+        };
+    Defer defer_submitted{signal_submitted};
+
     auto& inflight_mtx = *inflight_mutex_.get(frame_index);
     Defer defer{[&inflight_mtx]() { inflight_mtx.unlock(); }};
     co_await inflight_mtx.async_lock();
@@ -253,13 +293,6 @@ unifex::task<void> RenderingSubsystem::renderFrame(std::size_t frame_index, Fram
 	    my_windows.emplace_back(window.get());
     }
 
-    std::vector<std::optional<Window::SwapchainImage>> window_images;
-    window_images.reserve(my_windows.size());
-    for (auto& window : my_windows)
-    {
-        window_images.push_back(co_await window->acquireNext(frame_index));
-    }
-
     auto oneshot_pool = oneshot_->pool.get(frame_index)->get();
 
     Defer defer2{[this, frame_index, oneshot_pool]() { device_->resetCommandPool(oneshot_pool); }};
@@ -270,9 +303,23 @@ unifex::task<void> RenderingSubsystem::renderFrame(std::size_t frame_index, Fram
         .commandBufferCount = 1,
     })[0]);
 
-    cb->begin(vk::CommandBufferBeginInfo{.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
-    auto uploads_done = co_await gpu_storage_manager_->frameUpload(cb.get());
-    cb->end();
+    if (prepare_graph_ == nullptr || prepare_graph_->size() != my_windows.size() + 1)
+    {
+        rebuildPrepareGraph(my_windows.size());
+    }
+
+    prep_.frame_index = frame_index;
+    prep_.upload_cb = cb.get();
+    prep_.windows = my_windows;
+    prep_.images.assign(my_windows.size(), std::nullopt);
+    prep_.uploads.reset();
+    {
+        NG_TRACE_ASYNC_ZONE("Acquire images and record uploads");
+        co_await prepare_graph_->run();
+    }
+
+    auto window_images = std::move(prep_.images);
+    auto uploads_done = std::move(prep_.uploads).value();
 
     auto oneshot_fence = oneshot_->fence.get(frame_index)->get();
     
@@ -290,6 +337,7 @@ unifex::task<void> RenderingSubsystem::renderFrame(std::size_t frame_index, Fram
     renderings_done.reserve(window_images.size());
     for (std::size_t i = 0; i < window_images.size(); ++i)
     {
+        NG_TRACE_ZONE("Record and submit");
         if (window_images[i].has_value())
         {
             renderings_done.emplace_back(window_renderer_mapping_[my_windows[i]]
@@ -304,6 +352,7 @@ unifex::task<void> RenderingSubsystem::renderFrame(std::size_t frame_index, Fram
 
     for (std::size_t i = 0; i < my_windows.size(); ++i)
     {
+        NG_TRACE_ZONE("Present");
         if (window_images[i].has_value())
         {
             if (!my_windows[i]->present(renderings_done[i].value().sem, window_images[i].value().view))
@@ -317,6 +366,7 @@ unifex::task<void> RenderingSubsystem::renderFrame(std::size_t frame_index, Fram
 
     frame_mutex_.unlock();
 
+    signal_submitted();
 
 
 
@@ -339,6 +389,8 @@ unifex::task<void> RenderingSubsystem::renderFrame(std::size_t frame_index, Fram
 
     if (!fences.empty())
     {
+        NG_TRACE_ASYNC_ZONE("Wait for GPU");
+
         co_await unifex::schedule(g_engine.blockingScheduler());
 
         auto res = device_->waitForFences(fences, true, 1000000000);
@@ -346,7 +398,7 @@ unifex::task<void> RenderingSubsystem::renderFrame(std::size_t frame_index, Fram
         NG_VERIFY(res == vk::Result::eSuccess);
         device_->resetFences(fences);
 
-        co_await unifex::schedule(g_engine.mainScheduler());
+        co_await unifex::schedule(g_engine.mainScheduler(TaskPriority::Critical));
     }
 
     gpu_storage_manager_->frameUploadDone(std::move(uploads_done));
@@ -1,11 +1,13 @@
 #include "rendering/StaticMeshRenderer.hpp"
 
+#include <memory_resource>
 #include <unordered_set>
 #include <glm/ext/matrix_clip_space.hpp>
 
 #include "assets/AssetHandle.hpp"
 #include "rendering/gpu_storage/GpuStorageManager.hpp"
 #include "rendering/primitives/Shader.hpp"
+#include "rendering/TransformKernels.hpp"
 #include "shader_cpp_bridge/static_mesh.h"
 #include "util/Align.hpp"
 
@@ -214,13 +216,31 @@ StaticMeshRenderer::StaticMeshRenderer(CreateInfo info)
 
 void StaticMeshRenderer::render(std::size_t frame_index, vk::CommandBuffer cb, const FramePacket& packet)
 {
-	std::vector<StaticMeshPacket> static_meshes;
-	static_meshes.reserve(packet.static_meshes.size());
-	for (auto& mesh : packet.static_meshes)
+	// Scratch data is thrown away together with the packet
+	auto scratch = packet.memory();
+
+	struct MeshToDraw
+	{
+		const StaticMeshPacket* packet;
+		StaticMesh* model;
+	};
+
+	std::size_t mesh_count = 0;
+	for (auto& stage_meshes : packet.static_meshes)
 	{
-		if (storage_manager_->getStaticMesh(mesh.model) != nullptr)
+		mesh_count += stage_meshes.size();
+	}
+
+	std::pmr::vector<MeshToDraw> static_meshes{scratch};
+	static_meshes.reserve(mesh_count);
+	for (auto& stage_meshes : packet.static_meshes)
+	{
+		for (auto& mesh : stage_meshes)
 		{
-			static_meshes.emplace_back(mesh);
+			if (auto model = storage_manager_->getStaticMesh(mesh.model))
+			{
+				static_meshes.emplace_back(MeshToDraw{&mesh, model});
+			}
 		}
 	}
 
@@ -228,23 +248,34 @@ void StaticMeshRenderer::render(std::size_t frame_index, vk::CommandBuffer cb, c
 	{
 		Meshlet* meshlet;
 		uint32_t index;
-		glm::mat4x4 transform;
 	};
 
 	struct PerMaterial
 	{
 		uint32_t index;
-		std::vector<PerDrawCall> per_drawcall;
+		std::pmr::vector<PerDrawCall> per_drawcall;
 		StaticMesh* model;
 	};
 
+	std::size_t drawcall_count = 0;
+	for (auto&& [mesh, model] : static_meshes)
+	{
+		drawcall_count += model->meshlets.size();
+	}
+
+	// Indexed by PerDrawCall::index, so that the matrices go through the batch kernels together
+	std::pmr::vector<glm::mat4x4> mesh_transforms{scratch};
+	std::pmr::vector<glm::mat4x4> local_transforms{scratch};
+	std::pmr::vector<std::uint8_t> uniform_scales{scratch};
+	mesh_transforms.reserve(drawcall_count);
+	local_transforms.reserve(drawcall_count);
+	uniform_scales.reserve(drawcall_count);
+
 	uint32_t material_count = 0;
 	uint32_t meshlet_count = 0;
-	std::unordered_map<Material*, PerMaterial> per_material;
-	for (auto&& mesh : static_meshes)
+	std::pmr::unordered_map<Material*, PerMaterial> per_material{scratch};
+	for (auto&& [mesh, model] : static_meshes)
 	{
-		auto model = storage_manager_->getStaticMesh(mesh.model);
-
 		for(auto& meshlet : model->meshlets)
 		{
 			if (!per_material.contains(meshlet.material))
@@ -252,6 +283,7 @@ void StaticMeshRenderer::render(std::size_t frame_index, vk::CommandBuffer cb, c
 				per_material.emplace(meshlet.material,
 					PerMaterial{
 						.index = material_count++,
+						.per_drawcall = std::pmr::vector<PerDrawCall>{scratch},
 						.model = model,
 					});
 			}
@@ -260,8 +292,11 @@ void StaticMeshRenderer::render(std::size_t frame_index, vk::CommandBuffer cb, c
 			per.per_drawcall.emplace_back(PerDrawCall{
 					.meshlet = &meshlet,
 					.index = meshlet_count++,
-					.transform = mesh.transform * meshlet.local_transform,
 				});
+
+			mesh_transforms.push_back(mesh->transform);
+			local_transforms.push_back(meshlet.local_transform);
+			uniform_scales.push_back(mesh->uniform_scale && meshlet.uniform_scale);
 		}
 	}
 
@@ -289,7 +324,7 @@ void StaticMeshRenderer::render(std::size_t frame_index, vk::CommandBuffer cb, c
 	per_frame.materials.resize(material_count);
 
 	{
-		std::vector layouts(material_count, material_dsl_.get());
+		std::pmr::vector<vk::DescriptorSetLayout> layouts(material_count, material_dsl_.get(), scratch);
 		layouts.push_back(global_dsl_.get());
 		layouts.push_back(object_dsl_.get());
 	
@@ -305,7 +340,7 @@ void StaticMeshRenderer::render(std::size_t frame_index, vk::CommandBuffer cb, c
 		per_frame.object = std::move(sets[material_count + 1]);
 	}
 	
-	std::vector<vk::WriteDescriptorSet> writes;
+	std::pmr::vector<vk::WriteDescriptorSet> writes{scratch};
 	vk::DescriptorBufferInfo global_buffer_write{
 			.buffer = per_frame.global_ubo.get(),
 			.range = sizeof(GlobalUBO),
@@ -318,7 +353,7 @@ void StaticMeshRenderer::render(std::size_t frame_index, vk::CommandBuffer cb, c
 			.buffer = per_frame.object_ubos.get(),
 			.range = sizeof(ObjectUBO),
 		};
-	std::vector<vk::DescriptorImageInfo> texture_writes;
+	std::pmr::vector<vk::DescriptorImageInfo> texture_writes{scratch};
 	texture_writes.reserve(per_material.size() * 2);
 
 	{
@@ -391,16 +426,19 @@ void StaticMeshRenderer::render(std::size_t frame_index, vk::CommandBuffer cb, c
 
 	if (meshlet_count > 0)
 	{
+		// Models overwrite the mesh transforms, normals the local ones
+		auto& models = mesh_transforms;
+		auto& normals = local_transforms;
+		multiply_matrices(mesh_transforms, local_transforms, models);
+		normal_matrices(models, uniform_scales, normals);
+
 		auto data = per_frame.object_ubos.map();
 
-		for(auto&[_, m] : per_material)
+		for (uint32_t i = 0; i < meshlet_count; ++i)
 		{
-			for (auto& dc : m.per_drawcall)
-			{
-				auto ubo = reinterpret_cast<ObjectUBO*>(data + dc.index * oubo_size);
-				ubo->model = dc.transform;
-				ubo->normal = transpose(inverse(dc.transform));
-			}
+			auto ubo = reinterpret_cast<ObjectUBO*>(data + i * oubo_size);
+			ubo->model = models[i];
+			ubo->normal = normals[i];
 		}
 
 		per_frame.object_ubos.unmap();
@@ -0,0 +1,279 @@
+#include "rendering/TransformKernels.hpp"
+
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <string_view>
+#include <glm/geometric.hpp>
+#include <spdlog/spdlog.h>
+
+#include "rendering/TransformKernelsImpl.hpp"
+#include "util/Assert.hpp"
+#include "util/TargetInfo.hpp"
+
+#if defined(NG_ARCH_x86)
+#   include <immintrin.h>
+#   if defined(NG_COMPILER_MSVC)
+#       include <intrin.h>
+#   endif
+#endif
+
+
+// The kernels read the glm types as plain floats
+static_assert(sizeof(glm::vec3) == 3 * sizeof(float));
+static_assert(sizeof(glm::quat) == 4 * sizeof(float));
+static_assert(sizeof(glm::mat4) == 16 * sizeof(float));
+
+namespace
+{
+
+using transform_kernels::KernelTable;
+
+#if defined(NG_ARCH_x86)
+
+// SSE2 is always there on x86-64
+struct SsePack
+{
+    static constexpr std::size_t WIDTH = 4;
+
+    __m128 v;
+
+    static SsePack set1(float f) { return {_mm_set1_ps(f)}; }
+
+    friend SsePack operator+(SsePack a, SsePack b) { return {_mm_add_ps(a.v, b.v)}; }
+    friend SsePack operator-(SsePack a, SsePack b) { return {_mm_sub_ps(a.v, b.v)}; }
+    friend SsePack operator*(SsePack a, SsePack b) { return {_mm_mul_ps(a.v, b.v)}; }
+    friend SsePack operator/(SsePack a, SsePack b) { return {_mm_div_ps(a.v, b.v)}; }
+
+    static SsePack fmadd(SsePack a, SsePack b, SsePack c) { return {_mm_add_ps(_mm_mul_ps(a.v, b.v), c.v)}; }
+
+    static void load_vec4s(const float* in, std::size_t stride, SsePack* out)
+    {
+        auto r0 = _mm_loadu_ps(in);
+        auto r1 = _mm_loadu_ps(in + stride);
+        auto r2 = _mm_loadu_ps(in + 2 * stride);
+        auto r3 = _mm_loadu_ps(in + 3 * stride);
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        out[0] = {r0};
+        out[1] = {r1};
+        out[2] = {r2};
+        out[3] = {r3};
+    }
+
+    static void store_vec4s(const SsePack* in, float* out, std::size_t stride)
+    {
+        auto r0 = in[0].v;
+        auto r1 = in[1].v;
+        auto r2 = in[2].v;
+        auto r3 = in[3].v;
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        _mm_storeu_ps(out, r0);
+        _mm_storeu_ps(out + stride, r1);
+        _mm_storeu_ps(out + 2 * stride, r2);
+        _mm_storeu_ps(out + 3 * stride, r3);
+    }
+
+    static void load_vec3s(const float* in, SsePack (&out)[3])
+    {
+        for (std::size_t k = 0; k < 3; ++k)
+        {
+            out[k] = {_mm_setr_ps(in[k], in[3 + k], in[6 + k], in[9 + k])};
+        }
+    }
+};
+
+bool cpu_has_avx2()
+{
+#if defined(NG_COMPILER_MSVC)
+    int info[4];
+    __cpuid(info, 1);
+    bool fma = info[2] & (1 << 12);
+    bool osxsave = info[2] & (1 << 27);
+    bool avx = info[2] & (1 << 28);
+    // The OS also has to preserve the upper halves of the registers
+    if (!fma || !osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+    {
+        return false;
+    }
+
+    __cpuidex(info, 7, 0);
+    return info[1] & (1 << 5);
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+
+#else
+
+struct ScalarPack
+{
+    static constexpr std::size_t WIDTH = 1;
+
+    float v;
+
+    static ScalarPack set1(float f) { return {f}; }
+
+    friend ScalarPack operator+(ScalarPack a, ScalarPack b) { return {a.v + b.v}; }
+    friend ScalarPack operator-(ScalarPack a, ScalarPack b) { return {a.v - b.v}; }
+    friend ScalarPack operator*(ScalarPack a, ScalarPack b) { return {a.v * b.v}; }
+    friend ScalarPack operator/(ScalarPack a, ScalarPack b) { return {a.v / b.v}; }
+
+    static ScalarPack fmadd(ScalarPack a, ScalarPack b, ScalarPack c) { return {a.v * b.v + c.v}; }
+
+    static void load_vec4s(const float* in, std::size_t, ScalarPack* out)
+    {
+        for (std::size_t k = 0; k < 4; ++k)
+        {
+            out[k] = {in[k]};
+        }
+    }
+
+    static void store_vec4s(const ScalarPack* in, float* out, std::size_t)
+    {
+        for (std::size_t k = 0; k < 4; ++k)
+        {
+            out[k] = in[k].v;
+        }
+    }
+
+    static void load_vec3s(const float* in, ScalarPack (&out)[3])
+    {
+        for (std::size_t k = 0; k < 3; ++k)
+        {
+            out[k] = {in[k]};
+        }
+    }
+};
+
+#endif
+
+#if defined(NG_ARCH_x86)
+constexpr auto BASELINE_TABLE = transform_kernels::make_kernel_table<SsePack>("sse2");
+#else
+constexpr auto BASELINE_TABLE = transform_kernels::make_kernel_table<ScalarPack>("scalar");
+#endif
+
+// nullptr if the build or the CPU doesn't support it
+const KernelTable* find_table(std::string_view isa)
+{
+    if (isa == BASELINE_TABLE.name)
+    {
+        return &BASELINE_TABLE;
+    }
+
+#if defined(NG_ARCH_x86)
+    // Nothing from the AVX2 translation unit may run before the check
+    if (isa == "avx2" && cpu_has_avx2())
+    {
+        return transform_kernels::avx2_kernel_table();
+    }
+#endif
+
+    return nullptr;
+}
+
+const KernelTable& best_kernels()
+{
+    static const KernelTable& table = []() -> const KernelTable&
+        {
+            auto avx2 = find_table("avx2");
+            auto& result = avx2 != nullptr ? *avx2 : BASELINE_TABLE;
+            spdlog::info("Transform kernels use {}", result.name);
+            return result;
+        }();
+    return table;
+}
+
+std::atomic<const KernelTable*> g_forced_kernels{nullptr};
+
+const KernelTable& kernels()
+{
+    auto forced = g_forced_kernels.load(std::memory_order::relaxed);
+    return forced != nullptr ? *forced : best_kernels();
+}
+
+}
+
+void compose_trs(std::span<const glm::vec3> positions, std::span<const glm::quat> rotations,
+    std::span<const glm::vec3> scales, std::span<glm::mat4> out)
+{
+    NG_ASSERT(positions.size() == out.size() && rotations.size() == out.size() && scales.size() == out.size());
+    kernels().compose_trs(
+        reinterpret_cast<const float*>(positions.data()),
+        reinterpret_cast<const float*>(rotations.data()),
+        reinterpret_cast<const float*>(scales.data()),
+        reinterpret_cast<float*>(out.data()),
+        out.size());
+}
+
+void multiply_matrices(std::span<const glm::mat4> lhs, std::span<const glm::mat4> rhs, std::span<glm::mat4> out)
+{
+    NG_ASSERT(lhs.size() == out.size() && rhs.size() == out.size());
+    kernels().multiply(
+        reinterpret_cast<const float*>(lhs.data()), false,
+        reinterpret_cast<const float*>(rhs.data()),
+        reinterpret_cast<float*>(out.data()),
+        out.size());
+}
+
+void multiply_matrices(const glm::mat4& lhs, std::span<const glm::mat4> rhs, std::span<glm::mat4> out)
+{
+    NG_ASSERT(rhs.size() == out.size());
+    kernels().multiply(
+        reinterpret_cast<const float*>(&lhs), true,
+        reinterpret_cast<const float*>(rhs.data()),
+        reinterpret_cast<float*>(out.data()),
+        out.size());
+}
+
+void normal_matrices(std::span<const glm::mat4> models, std::span<const std::uint8_t> uniform_scale,
+    std::span<glm::mat4> out)
+{
+    NG_ASSERT(models.size() == out.size() && uniform_scale.size() == out.size());
+    kernels().normals(
+        reinterpret_cast<const float*>(models.data()),
+        uniform_scale.data(),
+        reinterpret_cast<float*>(out.data()),
+        out.size());
+}
+
+bool has_uniform_scale(const glm::mat4& m, float tolerance)
+{
+    glm::vec3 c0{m[0]};
+    glm::vec3 c1{m[1]};
+    glm::vec3 c2{m[2]};
+
+    // Relative to the squared scale, so that tiny models aren't always "uniform"
+    auto scale2 = dot(c0, c0);
+    auto eps = tolerance * scale2;
+
+    return std::abs(dot(c1, c1) - scale2) <= eps
+        && std::abs(dot(c2, c2) - scale2) <= eps
+        && std::abs(dot(c0, c1)) <= eps
+        && std::abs(dot(c0, c2)) <= eps
+        && std::abs(dot(c1, c2)) <= eps;
+}
+
+const char* transform_kernels_isa()
+{
+    return kernels().name;
+}
+
+bool force_transform_kernels_isa(const char* isa)
+{
+    if (isa == nullptr)
+    {
+        g_forced_kernels.store(nullptr, std::memory_order::relaxed);
+        return true;
+    }
+
+    auto table = find_table(isa);
+    if (table == nullptr)
+    {
+        return false;
+    }
+
+    g_forced_kernels.store(table, std::memory_order::relaxed);
+    return true;
+}
@@ -0,0 +1,92 @@
+// Compiled with AVX2 and FMA enabled, see engine/CMakeLists.txt.
+// Only reached after the CPU has been checked, so keep everything else out of here.
+
+#include "rendering/TransformKernelsImpl.hpp"
+
+#if defined(__AVX2__)
+#   include <immintrin.h>
+#endif
+
+
+namespace
+{
+
+#if defined(__AVX2__)
+
+struct Avx2Pack
+{
+    static constexpr std::size_t WIDTH = 8;
+
+    __m256 v;
+
+    static Avx2Pack set1(float f) { return {_mm256_set1_ps(f)}; }
+
+    friend Avx2Pack operator+(Avx2Pack a, Avx2Pack b) { return {_mm256_add_ps(a.v, b.v)}; }
+    friend Avx2Pack operator-(Avx2Pack a, Avx2Pack b) { return {_mm256_sub_ps(a.v, b.v)}; }
+    friend Avx2Pack operator*(Avx2Pack a, Avx2Pack b) { return {_mm256_mul_ps(a.v, b.v)}; }
+    friend Avx2Pack operator/(Avx2Pack a, Avx2Pack b) { return {_mm256_div_ps(a.v, b.v)}; }
+
+    static Avx2Pack fmadd(Avx2Pack a, Avx2Pack b, Avx2Pack c) { return {_mm256_fmadd_ps(a.v, b.v, c.v)}; }
+
+    // Lanes 0-3 and 4-7 are transposed separately and then glued together
+    static void load_vec4s(const float* in, std::size_t stride, Avx2Pack* out)
+    {
+        __m128 lo[4];
+        __m128 hi[4];
+        for (std::size_t i = 0; i < 4; ++i)
+        {
+            lo[i] = _mm_loadu_ps(in + i * stride);
+            hi[i] = _mm_loadu_ps(in + (i + 4) * stride);
+        }
+        _MM_TRANSPOSE4_PS(lo[0], lo[1], lo[2], lo[3]);
+        _MM_TRANSPOSE4_PS(hi[0], hi[1], hi[2], hi[3]);
+
+        for (std::size_t k = 0; k < 4; ++k)
+        {
+            out[k] = {_mm256_set_m128(hi[k], lo[k])};
+        }
+    }
+
+    static void store_vec4s(const Avx2Pack* in, float* out, std::size_t stride)
+    {
+        __m128 lo[4];
+        __m128 hi[4];
+        for (std::size_t k = 0; k < 4; ++k)
+        {
+            lo[k] = _mm256_castps256_ps128(in[k].v);
+            hi[k] = _mm256_extractf128_ps(in[k].v, 1);
+        }
+        _MM_TRANSPOSE4_PS(lo[0], lo[1], lo[2], lo[3]);
+        _MM_TRANSPOSE4_PS(hi[0], hi[1], hi[2], hi[3]);
+
+        for (std::size_t i = 0; i < 4; ++i)
+        {
+            _mm_storeu_ps(out + i * stride, lo[i]);
+            _mm_storeu_ps(out + (i + 4) * stride, hi[i]);
+        }
+    }
+
+    static void load_vec3s(const float* in, Avx2Pack (&out)[3])
+    {
+        auto indices = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+        for (std::size_t k = 0; k < 3; ++k)
+        {
+            out[k] = {_mm256_i32gather_ps(in + k, indices, 4)};
+        }
+    }
+};
+
+constexpr auto AVX2_TABLE = transform_kernels::make_kernel_table<Avx2Pack>("avx2");
+
+#endif
+
+}
+
+const transform_kernels::KernelTable* transform_kernels::avx2_kernel_table()
+{
+#if defined(__AVX2__)
+    return &AVX2_TABLE;
+#else
+    return nullptr;
+#endif
+}
@@ -0,0 +1,315 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+
+// Kernels behind rendering/TransformKernels.hpp, written once against a "pack"
+// of WIDTH floats and instantiated for every instruction set in its own
+// translation unit. A pack type has to provide set1, + - * /, fmadd and the
+// loads and stores below, which transpose WIDTH consecutive vectors into one
+// pack per component (SoA) and back.
+//
+// Nothing in here may be an inline non-template function or instantiate
+// templates from other headers: this file gets compiled with AVX2 enabled,
+// and the linker is free to pick that copy for callers on any CPU.
+// Pack types live in anonymous namespaces for the same reason.
+
+namespace transform_kernels
+{
+
+// Matrices are 16 column-major floats, vec3s are 3 floats and quaternions are x, y, z, w
+struct KernelTable
+{
+    const char* name;
+    void (*compose_trs)(const float* positions, const float* rotations, const float* scales,
+        float* out, std::size_t count);
+    // With broadcast_lhs, lhs is a single matrix used for every rhs
+    void (*multiply)(const float* lhs, bool broadcast_lhs, const float* rhs,
+        float* out, std::size_t count);
+    void (*normals)(const float* models, const std::uint8_t* uniform_scale,
+        float* out, std::size_t count);
+};
+
+// nullptr if the build can't produce AVX2 code, has to be checked against the CPU first
+const KernelTable* avx2_kernel_table();
+
+template<class P>
+void load_matrices(const float* in, P (&m)[16])
+{
+    for (std::size_t c = 0; c < 4; ++c)
+    {
+        P::load_vec4s(in + 4 * c, 16, m + 4 * c);
+    }
+}
+
+template<class P>
+void store_matrices(const P (&m)[16], float* out)
+{
+    for (std::size_t c = 0; c < 4; ++c)
+    {
+        P::store_vec4s(m + 4 * c, out + 4 * c, 16);
+    }
+}
+
+template<class P>
+void compose_trs_block(const float* positions, const float* rotations, const float* scales, float* out)
+{
+    P t[3];
+    P q[4];
+    P s[3];
+    P::load_vec3s(positions, t);
+    P::load_vec4s(rotations, 4, q);
+    P::load_vec3s(scales, s);
+
+    auto zero = P::set1(0.f);
+    auto one = P::set1(1.f);
+    auto two = P::set1(2.f);
+
+    // Same as glm::mat3_cast
+    auto xx = q[0] * q[0];
+    auto yy = q[1] * q[1];
+    auto zz = q[2] * q[2];
+    auto xy = q[0] * q[1];
+    auto xz = q[0] * q[2];
+    auto yz = q[1] * q[2];
+    auto wx = q[3] * q[0];
+    auto wy = q[3] * q[1];
+    auto wz = q[3] * q[2];
+
+    P m[16];
+    m[0] = (one - two * (yy + zz)) * s[0];
+    m[1] = two * (xy + wz) * s[0];
+    m[2] = two * (xz - wy) * s[0];
+    m[3] = zero;
+
+    m[4] = two * (xy - wz) * s[1];
+    m[5] = (one - two * (xx + zz)) * s[1];
+    m[6] = two * (yz + wx) * s[1];
+    m[7] = zero;
+
+    m[8] = two * (xz + wy) * s[2];
+    m[9] = two * (yz - wx) * s[2];
+    m[10] = (one - two * (xx + yy)) * s[2];
+    m[11] = zero;
+
+    m[12] = t[0];
+    m[13] = t[1];
+    m[14] = t[2];
+    m[15] = one;
+
+    store_matrices(m, out);
+}
+
+template<class P>
+void multiply_block(const P (&a)[16], const float* rhs, float* out)
+{
+    P b[16];
+    load_matrices(rhs, b);
+
+    P r[16];
+    for (std::size_t c = 0; c < 4; ++c)
+    {
+        for (std::size_t row = 0; row < 4; ++row)
+        {
+            auto sum = a[row] * b[4 * c];
+            sum = P::fmadd(a[4 + row], b[4 * c + 1], sum);
+            sum = P::fmadd(a[8 + row], b[4 * c + 2], sum);
+            r[4 * c + row] = P::fmadd(a[12 + row], b[4 * c + 3], sum);
+        }
+    }
+
+    store_matrices(r, out);
+}
+
+template<class P>
+void cross(const P (&a)[3], const P (&b)[3], P (&out)[3])
+{
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+template<class P>
+void normals_block(const float* models, bool uniform_scale, float* out)
+{
+    P m[16];
+    load_matrices(models, m);
+
+    P c[3][3] = {
+        {m[0], m[1], m[2]},
+        {m[4], m[5], m[6]},
+        {m[8], m[9], m[10]},
+    };
+
+    auto zero = P::set1(0.f);
+    auto one = P::set1(1.f);
+
+    P n[3][3];
+    if (uniform_scale)
+    {
+        // M = sR, so its inverse transpose is R / s = M / s^2
+        auto inv = one / (c[0][0] * c[0][0] + c[0][1] * c[0][1] + c[0][2] * c[0][2]);
+        for (std::size_t i = 0; i < 3; ++i)
+        {
+            for (std::size_t j = 0; j < 3; ++j)
+            {
+                n[i][j] = c[i][j] * inv;
+            }
+        }
+    }
+    else
+    {
+        // Rows of the inverse are the cross products of the columns over the determinant
+        cross(c[1], c[2], n[0]);
+        cross(c[2], c[0], n[1]);
+        cross(c[0], c[1], n[2]);
+
+        auto inv = one / (c[0][0] * n[0][0] + c[0][1] * n[0][1] + c[0][2] * n[0][2]);
+        for (std::size_t i = 0; i < 3; ++i)
+        {
+            for (std::size_t j = 0; j < 3; ++j)
+            {
+                n[i][j] = n[i][j] * inv;
+            }
+        }
+    }
+
+    P r[16] = {
+        n[0][0], n[0][1], n[0][2], zero,
+        n[1][0], n[1][1], n[1][2], zero,
+        n[2][0], n[2][1], n[2][2], zero,
+        zero, zero, zero, one,
+    };
+    store_matrices(r, out);
+}
+
+// Copies the last rest elements of N floats and repeats the last one up to WIDTH,
+// so that the lanes past the end compute something harmless
+template<std::size_t N, std::size_t WIDTH>
+void pad_tail(float (&dst)[N * WIDTH], const float* src, std::size_t rest)
+{
+    std::memcpy(dst, src, rest * N * sizeof(float));
+    for (std::size_t i = rest; i < WIDTH; ++i)
+    {
+        std::memcpy(dst + i * N, src + (rest - 1) * N, N * sizeof(float));
+    }
+}
+
+template<class P>
+void compose_trs(const float* positions, const float* rotations, const float* scales,
+    float* out, std::size_t count)
+{
+    constexpr auto W = P::WIDTH;
+
+    std::size_t i = 0;
+    for (; i + W <= count; i += W)
+    {
+        compose_trs_block<P>(positions + 3 * i, rotations + 4 * i, scales + 3 * i, out + 16 * i);
+    }
+
+    if (auto rest = count - i; rest > 0)
+    {
+        float t[3 * W];
+        float q[4 * W];
+        float s[3 * W];
+        float m[16 * W];
+        pad_tail<3, W>(t, positions + 3 * i, rest);
+        pad_tail<4, W>(q, rotations + 4 * i, rest);
+        pad_tail<3, W>(s, scales + 3 * i, rest);
+        compose_trs_block<P>(t, q, s, m);
+        std::memcpy(out + 16 * i, m, rest * 16 * sizeof(float));
+    }
+}
+
+template<class P>
+void multiply(const float* lhs, bool broadcast_lhs, const float* rhs, float* out, std::size_t count)
+{
+    constexpr auto W = P::WIDTH;
+
+    P a[16];
+    if (broadcast_lhs)
+    {
+        for (std::size_t e = 0; e < 16; ++e)
+        {
+            a[e] = P::set1(lhs[e]);
+        }
+    }
+
+    // Everything is loaded before anything is stored, so out may alias either input
+    std::size_t i = 0;
+    for (; i + W <= count; i += W)
+    {
+        if (!broadcast_lhs)
+        {
+            load_matrices(lhs + 16 * i, a);
+        }
+        multiply_block(a, rhs + 16 * i, out + 16 * i);
+    }
+
+    if (auto rest = count - i; rest > 0)
+    {
+        float b[16 * W];
+        float m[16 * W];
+        if (!broadcast_lhs)
+        {
+            pad_tail<16, W>(m, lhs + 16 * i, rest);
+            load_matrices(m, a);
+        }
+        pad_tail<16, W>(b, rhs + 16 * i, rest);
+        multiply_block(a, b, m);
+        std::memcpy(out + 16 * i, m, rest * 16 * sizeof(float));
+    }
+}
+
+template<std::size_t WIDTH>
+bool all_uniform(const std::uint8_t* flags)
+{
+    for (std::size_t i = 0; i < WIDTH; ++i)
+    {
+        if (flags[i] == 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<class P>
+void normals(const float* models, const std::uint8_t* uniform_scale, float* out, std::size_t count)
+{
+    constexpr auto W = P::WIDTH;
+
+    // A block only takes the fast path if all of its matrices can
+    std::size_t i = 0;
+    for (; i + W <= count; i += W)
+    {
+        normals_block<P>(models + 16 * i, all_uniform<W>(uniform_scale + i), out + 16 * i);
+    }
+
+    if (auto rest = count - i; rest > 0)
+    {
+        std::uint8_t flags[W];
+        std::memcpy(flags, uniform_scale + i, rest);
+        std::memset(flags + rest, uniform_scale[count - 1], W - rest);
+
+        float m[16 * W];
+        pad_tail<16, W>(m, models + 16 * i, rest);
+        normals_block<P>(m, all_uniform<W>(flags), m);
+        std::memcpy(out + 16 * i, m, rest * 16 * sizeof(float));
+    }
+}
+
+template<class P>
+constexpr KernelTable make_kernel_table(const char* name)
+{
+    return KernelTable{
+        .name = name,
+        .compose_trs = &compose_trs<P>,
+        .multiply = &multiply<P>,
+        .normals = &normals<P>,
+    };
+}
+
+}
@@ -73,7 +73,7 @@ Window::Window(CreateInfo info)
 }
 
 auto Window::acquireNext(std::size_t frame_index)
-	-> unifex::task<std::optional<SwapchainImage>>
+	-> PooledTask<std::optional<SwapchainImage>>
 {
     if (swapchain_missing_.load())
     {
@@ -2,15 +2,22 @@
 
 #include <numeric>
 #include <stack>
+#include <unordered_map>
 #include <backends/imgui_impl_vulkan.h>
 #include <glm/ext/matrix_transform.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <unifex/on.hpp>
 
+#include "concurrency/ParallelFor.hpp"
+#include "rendering/TransformKernels.hpp"
 #include "core/EngineHandle.hpp"
 #include "util/Defer.hpp"
+#include "util/Trace.hpp"
 
 
+// Interleaving a vertex is a couple of memcpys, so chunks have to be big
+constexpr std::size_t INTERLEAVE_GRAIN = 4096;
+
 
 GpuStorageManager::GpuStorageManager(CreateInfo info)
 	: device_{info.device}
@@ -92,20 +99,17 @@ std::vector<glm::mat4x4> GpuStorageManager::calculate_node_total_transforms(cons
 
 unifex::task<void> GpuStorageManager::uploadStaticMesh(AssetHandle handle, const tinygltf::Model& model)
 {
-	{
-		co_await uploaded_mtx_.async_lock();
-		Defer defer{[this]() { uploaded_mtx_.unlock(); }};
-
-		if (uploaded_assets_.contains(handle))
-		{
-			co_return;
-		}
+	NG_TRACE_ASYNC_ZONE("GpuStorageManager::uploadStaticMesh");
 
-		uploaded_assets_.emplace(handle);
+	// Most requests are for assets that are already there, these don't lock
+	if (uploaded_assets_.contains(handle) || !uploaded_assets_.try_emplace(handle).second)
+	{
+		co_return;
 	}
 
 	
-	co_await unifex::schedule(g_engine.blockingScheduler());
+	// Preparing the upload is plain CPU work, but it must not delay the frame
+	co_await unifex::schedule(g_engine.mainScheduler(TaskPriority::Background));
 
 	StaticMesh result;
 	
@@ -274,8 +278,9 @@ unifex::task<void> GpuStorageManager::uploadStaticMesh(AssetHandle handle, const
 
 			for (auto& prim : model.meshes[mesh_idx].primitives)
 			{
-				result.meshlets.emplace_back(meshlet_templates.at(&prim))
-					.local_transform = total_transforms[i];
+				auto& meshlet = result.meshlets.emplace_back(meshlet_templates.at(&prim));
+				meshlet.local_transform = total_transforms[i];
+				meshlet.uniform_scale = has_uniform_scale(total_transforms[i]);
 			}
 		}
 		
@@ -372,23 +377,41 @@ unifex::task<void> GpuStorageManager::uploadStaticMesh(AssetHandle handle, const
 							+ views[2]->byteOffset + accs[2]->byteOffset,
 					};
 
-					for (std::size_t i = 0; i < accs[0]->count; ++i)
-					{
-						// TODO: refactor this crappy swizzle
-						std::memcpy(data + offset, currs[0], sizes[0]);
-						offset += sizes[0];
-						std::memcpy(data + offset, currs[2], sizes[2]/2);
-						offset += sizes[2]/2;
-						std::memcpy(data + offset, currs[1], sizes[1]);
-						offset += sizes[1];
-						std::memcpy(data + offset, currs[2] + sizes[2]/2, sizes[2]/2);
-						offset += sizes[2]/2;
-							
-						for (std::size_t j = 0; j < 3; ++j)
+					std::array strides{
+						static_cast<std::size_t>(accs[0]->ByteStride(*views[0])),
+						static_cast<std::size_t>(accs[1]->ByteStride(*views[1])),
+						static_cast<std::size_t>(accs[2]->ByteStride(*views[2])),
+					};
+
+					auto vertex_size = sizes[0] + sizes[1] + sizes[2];
+					auto vertex_count = accs[0]->count;
+					auto dst = data + offset;
+
+					// Every vertex lands at a known place, so the swizzle can be split freely
+					co_await parallel_for(g_engine.mainScheduler(TaskPriority::Background), vertex_count,
+						[dst, &currs, &strides, &sizes, vertex_size](std::size_t begin, std::size_t end)
 						{
-							currs[j] += accs[j]->ByteStride(*views[j]);
-						}
-					}
+							NG_TRACE_ZONE("Interleave vertices");
+							for (std::size_t i = begin; i < end; ++i)
+							{
+								auto out = dst + i * vertex_size;
+								auto position = currs[0] + i * strides[0];
+								auto normal = currs[1] + i * strides[1];
+								auto uv = currs[2] + i * strides[2];
+
+								// TODO: refactor this crappy swizzle
+								std::memcpy(out, position, sizes[0]);
+								out += sizes[0];
+								std::memcpy(out, uv, sizes[2]/2);
+								out += sizes[2]/2;
+								std::memcpy(out, normal, sizes[1]);
+								out += sizes[1];
+								std::memcpy(out, uv + sizes[2]/2, sizes[2]/2);
+							}
+						},
+						INTERLEAVE_GRAIN);
+
+					offset += static_cast<uint32_t>(vertex_count * vertex_size);
 
 					uploadBuffer(idx_start, offset - idx_start, result.vertex_buffer.get(),
 						result.meshlets[meshlet_idx].vertex_offset
@@ -418,20 +441,14 @@ unifex::task<void> GpuStorageManager::uploadStaticMesh(AssetHandle handle, const
 	}
 	uploads_mtx_.unlock();
 
-	co_await unifex::on(g_engine.mainScheduler(), done.async_wait());
+	co_await unifex::on(g_engine.mainScheduler(TaskPriority::Background), done.async_wait());
 	
 	co_return;
 }
 
-StaticMesh* GpuStorageManager::getStaticMesh(AssetHandle handle)
+StaticMesh* GpuStorageManager::getStaticMesh(const AssetHandle& handle)
 {
-	auto it = static_meshes_.find(handle);
-	if (it == static_meshes_.end())
-	{
-		return nullptr;
-	}
-
-	return &it->second;
+	return static_meshes_.find(handle);
 }
 
 unifex::task<void> GpuStorageManager::uploadGuiData(ImGuiContext* context)
@@ -449,7 +466,7 @@ unifex::task<void> GpuStorageManager::uploadGuiData(ImGuiContext* context)
 	co_return;
 }
 
-unifex::task<GpuStorageManager::UploadResult> GpuStorageManager::frameUpload(vk::CommandBuffer cb)
+PooledTask<GpuStorageManager::UploadResult> GpuStorageManager::frameUpload(vk::CommandBuffer cb)
 {
 	decltype(buffer_uploads_) buffer_uploads;
 	decltype(image_uploads_) image_uploads;
@@ -560,9 +577,9 @@ unifex::task<GpuStorageManager::UploadResult> GpuStorageManager::frameUpload(vk:
 
 void GpuStorageManager::frameUploadDone(UploadResult result)
 {
-	for (auto&& p : result.static_meshes)
+	for (auto&& [handle, mesh] : result.static_meshes)
 	{
-		static_meshes_.emplace(std::move(p));
+		static_meshes_.try_emplace(std::move(handle), std::move(mesh));
 	}
 
 	for (auto context : result.gui_contexts)
@@ -0,0 +1,254 @@
+#include "util/Trace.hpp"
+
+#if NG_TRACING
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+struct TraceEvent
+{
+    const char* name;
+    std::uint64_t timestamp_ns;
+    std::uint64_t id;
+    TraceEventType type;
+};
+
+constexpr std::size_t CHUNK_EVENTS = 4096;
+// Caps the memory used by a single thread at about 32MB, later events get dropped
+constexpr std::size_t MAX_CHUNKS_PER_THREAD = 256;
+
+// Append-only: the owner fills events and then publishes them by bumping count,
+// so readers never see an event that is being written
+struct Chunk
+{
+    std::array<TraceEvent, CHUNK_EVENTS> events;
+    std::atomic<std::size_t> count{0};
+    std::atomic<Chunk*> next{nullptr};
+};
+
+struct ThreadBuffer
+{
+    explicit ThreadBuffer(std::uint64_t thread_id)
+        : tid{thread_id}
+        , first{std::make_unique<Chunk>()}
+        , current{first.get()}
+    {
+    }
+
+    ~ThreadBuffer()
+    {
+        auto chunk = first->next.load(std::memory_order::relaxed);
+        while (chunk != nullptr)
+        {
+            auto next = chunk->next.load(std::memory_order::relaxed);
+            delete chunk;
+            chunk = next;
+        }
+    }
+
+    std::uint64_t tid;
+    // Guarded by the registry mutex
+    std::string name;
+
+    std::unique_ptr<Chunk> first;
+    // Owner only
+    Chunk* current;
+    std::size_t chunk_count{1};
+
+    std::atomic<std::uint64_t> dropped{0};
+};
+
+// Buffers outlive their threads, so that events of exited threads still get written
+struct Registry
+{
+    std::mutex mtx;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+
+    std::atomic<bool> enabled{false};
+    std::atomic<std::uint64_t> next_id{1};
+    Clock::time_point epoch{Clock::now()};
+};
+
+Registry& registry()
+{
+    static Registry instance;
+    return instance;
+}
+
+thread_local ThreadBuffer* this_thread_buffer = nullptr;
+
+ThreadBuffer& current_thread_buffer()
+{
+    if (this_thread_buffer == nullptr)
+    {
+        auto& reg = registry();
+        std::lock_guard lock{reg.mtx};
+        auto& buffer = reg.buffers.emplace_back(std::make_unique<ThreadBuffer>(reg.buffers.size() + 1));
+        buffer->name = "Thread " + std::to_string(buffer->tid);
+        this_thread_buffer = buffer.get();
+    }
+
+    return *this_thread_buffer;
+}
+
+void write_escaped(std::ostream& out, std::string_view str)
+{
+    for (char c : str)
+    {
+        if (c == '"' || c == '\\')
+        {
+            out << '\\';
+        }
+        out << c;
+    }
+}
+
+void write_event(std::ostream& out, const TraceEvent& event, std::uint64_t tid)
+{
+    out << ",\n{\"name\":\"";
+    write_escaped(out, event.name);
+    out << "\",\"pid\":1,\"tid\":" << tid
+        << ",\"ts\":" << event.timestamp_ns / 1000 << '.' << event.timestamp_ns % 1000 / 100;
+
+    switch (event.type)
+    {
+    case TraceEventType::Begin:
+        out << ",\"ph\":\"B\"}";
+        break;
+    case TraceEventType::End:
+        out << ",\"ph\":\"E\"}";
+        break;
+    case TraceEventType::AsyncBegin:
+        out << ",\"cat\":\"async\",\"ph\":\"b\",\"id\":" << event.id << '}';
+        break;
+    case TraceEventType::AsyncEnd:
+        out << ",\"cat\":\"async\",\"ph\":\"e\",\"id\":" << event.id << '}';
+        break;
+    case TraceEventType::FlowStart:
+        out << ",\"cat\":\"flow\",\"ph\":\"s\",\"id\":" << event.id << '}';
+        break;
+    case TraceEventType::FlowEnd:
+        out << ",\"cat\":\"flow\",\"ph\":\"f\",\"bp\":\"e\",\"id\":" << event.id << '}';
+        break;
+    }
+}
+
+}
+
+bool detail::trace_enabled() noexcept
+{
+    return registry().enabled.load(std::memory_order::relaxed);
+}
+
+void trace_set_enabled(bool enabled) noexcept
+{
+    registry().enabled.store(enabled, std::memory_order::relaxed);
+}
+
+void trace_record(TraceEventType type, const char* name, std::uint64_t id) noexcept
+{
+    auto timestamp = Clock::now() - registry().epoch;
+
+    auto& buffer = current_thread_buffer();
+    auto chunk = buffer.current;
+    auto count = chunk->count.load(std::memory_order::relaxed);
+
+    if (count == CHUNK_EVENTS)
+    {
+        if (buffer.chunk_count == MAX_CHUNKS_PER_THREAD)
+        {
+            buffer.dropped.fetch_add(1, std::memory_order::relaxed);
+            return;
+        }
+
+        auto next = new Chunk;
+        chunk->next.store(next, std::memory_order::release);
+        buffer.current = next;
+        ++buffer.chunk_count;
+        chunk = next;
+        count = 0;
+    }
+
+    chunk->events[count] = TraceEvent{
+        .name = name,
+        .timestamp_ns = static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(timestamp).count()),
+        .id = id,
+        .type = type,
+    };
+    chunk->count.store(count + 1, std::memory_order::release);
+}
+
+std::uint64_t trace_next_id() noexcept
+{
+    return registry().next_id.fetch_add(1, std::memory_order::relaxed);
+}
+
+void trace_set_thread_name(std::string name)
+{
+    auto& buffer = current_thread_buffer();
+    std::lock_guard lock{registry().mtx};
+    buffer.name = std::move(name);
+}
+
+bool write_chrome_trace(const std::filesystem::path& path)
+{
+    std::ofstream out(path);
+    if (!out)
+    {
+        spdlog::error("Unable to open {} for writing the trace", path.string());
+        return false;
+    }
+
+    auto& reg = registry();
+    std::lock_guard lock{reg.mtx};
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+        << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"HipNg\"}}";
+
+    std::uint64_t dropped = 0;
+    for (auto& buffer : reg.buffers)
+    {
+        out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid
+            << ",\"args\":{\"name\":\"";
+        write_escaped(out, buffer->name);
+        out << "\"}}";
+
+        for (auto chunk = buffer->first.get(); chunk != nullptr; chunk = chunk->next.load(std::memory_order::acquire))
+        {
+            auto count = chunk->count.load(std::memory_order::acquire);
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                write_event(out, chunk->events[i], buffer->tid);
+            }
+        }
+
+        dropped += buffer->dropped.load(std::memory_order::relaxed);
+    }
+
+    out << "\n]}\n";
+
+    if (dropped > 0)
+    {
+        spdlog::warn("{} trace events were dropped because the trace buffers were full", dropped);
+    }
+
+    spdlog::info("Trace written to {}", path.string());
+
+    return static_cast<bool>(out);
+}
+
+#endif
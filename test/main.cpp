@@ -1,14 +1,1279 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <exception>
 #include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
 
+#include <unifex/inplace_stop_token.hpp>
+#include <unifex/just.hpp>
+#include <unifex/just_done.hpp>
+#include <unifex/sync_wait.hpp>
+#include <flecs.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <concurrency/AdaptiveMutex.hpp>
+#include <concurrency/AsyncRwLock.hpp>
+#include <concurrency/AsyncSemaphore.hpp>
 #include <concurrency/AtomicUIntTuple.hpp>
+#include <concurrency/ConcurrentHashMap.hpp>
+#include <concurrency/FrameAllocator.hpp>
+#include <concurrency/FrameArena.hpp>
+#include <concurrency/ParallelFor.hpp>
+#include <concurrency/PooledTask.hpp>
 #include <concurrency/ThreadPool.hpp>
 #include <concurrency/BlockingThreadPool.hpp>
 #include <concurrency/StaticScope.hpp>
+#include <concurrency/TaskGraph.hpp>
+#include <concurrency/TimerWheel.hpp>
+#include <concurrency/WorkStealingDeque.hpp>
+#include <core/FlecsOsApi.hpp>
+#include <core/GameplaySystem.hpp>
+#include <rendering/TransformKernels.hpp>
+#include <concurrency/LockfreeQueue.hpp>
+#include <concurrency/SchedulerStats.hpp>
+#include <concurrency/TicketLock.hpp>
+
+
+
+namespace
+{
+
+struct TestNode
+{
+    std::size_t producer;
+    std::size_t value;
+    TestNode* next{nullptr};
+};
+
+bool test_lockfree_queue()
+{
+    constexpr std::size_t PRODUCERS = 4;
+    constexpr std::size_t PER_PRODUCER = 100000;
+
+    std::vector<TestNode> nodes(PRODUCERS * PER_PRODUCER);
+    LockfreeQueue<TestNode> queue;
+
+    std::vector<std::thread> producers;
+    for (std::size_t p = 0; p < PRODUCERS; ++p)
+    {
+        producers.emplace_back([&nodes, &queue, p]()
+            {
+                for (std::size_t i = 0; i < PER_PRODUCER; ++i)
+                {
+                    auto& node = nodes[p * PER_PRODUCER + i];
+                    node.producer = p;
+                    node.value = i;
+                    queue.push(&node);
+                }
+            });
+    }
+
+    // Every producer's items must come out exactly once and in order
+    std::vector<std::size_t> expected(PRODUCERS, 0);
+    auto check = [&expected](TestNode* node)
+        {
+            return node->value == expected[node->producer]++;
+        };
+
+    // Keeps draining after a failure, the producers have to be joined either way
+    bool ok = true;
+    std::size_t received = 0;
+    bool use_pop_all = false;
+    while (received < nodes.size())
+    {
+        if (use_pop_all)
+        {
+            for (auto node = queue.pop_all(); node != nullptr; node = node->next, ++received)
+            {
+                ok &= check(node);
+            }
+        }
+        else if (auto node = queue.pop())
+        {
+            ok &= check(node);
+            ++received;
+        }
+        use_pop_all = !use_pop_all;
+    }
+
+    for (auto& thread : producers)
+    {
+        thread.join();
+    }
+
+    return ok && queue.pop() == nullptr;
+}
+
+bool test_work_stealing_deque()
+{
+    constexpr std::size_t THIEVES = 3;
+    constexpr std::size_t ITEMS = 200000;
+    // Far more than the initial capacity, so the ring grows several times while being stolen from
+    constexpr std::size_t BURST = 16 * WorkStealingDeque<std::size_t>::INITIAL_CAPACITY;
+
+    std::vector<std::size_t> items(ITEMS);
+    std::vector<std::atomic<std::uint32_t>> seen(ITEMS);
+    for (std::size_t i = 0; i < ITEMS; ++i)
+    {
+        items[i] = i;
+    }
+
+    WorkStealingDeque<std::size_t> deque;
+    std::atomic<bool> owner_done{false};
+
+    std::vector<std::thread> thieves;
+    for (std::size_t t = 0; t < THIEVES; ++t)
+    {
+        thieves.emplace_back([&deque, &seen, &owner_done]()
+            {
+                while (true)
+                {
+                    // Read before stealing, so that nothing pushed earlier can be missed
+                    bool done = owner_done.load();
+                    if (auto item = deque.steal())
+                    {
+                        seen[*item].fetch_add(1);
+                    }
+                    else if (done && deque.empty())
+                    {
+                        return;
+                    }
+                }
+            });
+    }
+
+    for (std::size_t pushed = 0; pushed < ITEMS;)
+    {
+        auto burst_end = std::min(pushed + BURST, ITEMS);
+        for (; pushed < burst_end; ++pushed)
+        {
+            deque.push(&items[pushed]);
+        }
+
+        // Pop some of it back, racing the thieves for the last elements
+        for (std::size_t i = 0; i < BURST / 4; ++i)
+        {
+            if (auto item = deque.pop())
+            {
+                seen[*item].fetch_add(1);
+            }
+        }
+    }
+
+    while (auto item = deque.pop())
+    {
+        seen[*item].fetch_add(1);
+    }
+    owner_done.store(true);
+
+    for (auto& thief : thieves)
+    {
+        thief.join();
+    }
+
+    return std::all_of(seen.begin(), seen.end(), [](const auto& count) { return count.load() == 1; });
+}
+
+bool test_atomic_uint_tuple()
+{
+    // Fields wider than 31 bits used to get truncated
+    AtomicUIntTuple<40, 1, 23> tuple({(std::uint64_t{1} << 39) + 5, 1, 12345});
+
+    auto expected = tuple.load();
+    if (expected != decltype(expected){(std::uint64_t{1} << 39) + 5, 1, 12345})
+    {
+        return false;
+    }
+
+    // Values get truncated to their field, without touching the neighbours
+    if (!tuple.compare_exchange(expected, {1, 0, std::uint64_t{1} << 23}))
+    {
+        return false;
+    }
+
+    auto stale = expected;
+    if (tuple.compare_exchange(stale, {2, 0, 0}) || stale != decltype(stale){1, 0, 0})
+    {
+        return false;
+    }
+
+    AtomicUIntTuple<64> full({~std::uint64_t{0}});
+    return full.load()[0] == ~std::uint64_t{0};
+}
+
+bool test_latency_histogram()
+{
+    using std::chrono::nanoseconds;
+
+    LatencyHistogram histogram;
+    for (std::int64_t ns : {0, 1, 3, 100, 1000, 1000, 1000, 1000, 1000, 1000000})
+    {
+        ++histogram.buckets[LatencyHistogram::bucket_for(nanoseconds{ns})];
+    }
+
+    auto before = histogram;
+    histogram += before;
+    histogram -= before;
+
+    return histogram.count() == 10
+        && histogram.percentile(0.5) == nanoseconds{1024}
+        && histogram.percentile(1.0) == nanoseconds{1 << 20}
+        && LatencyHistogram{}.percentile(0.5) == nanoseconds{0};
+}
+
+// Several threads bump a plain counter under the lock, any lost update shows up in the total
+template<class Lock>
+bool check_lock_excludes()
+{
+    constexpr std::size_t THREADS = 4;
+    constexpr std::size_t INCREMENTS = 100000;
+
+    Lock lock;
+    std::size_t counter = 0;
+
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < THREADS; ++t)
+    {
+        threads.emplace_back([&lock, &counter]()
+            {
+                for (std::size_t i = 0; i < INCREMENTS; ++i)
+                {
+                    std::lock_guard guard{lock};
+                    ++counter;
+                }
+            });
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    return counter == THREADS * INCREMENTS;
+}
+
+// Spins until pred holds, false if that takes unreasonably long
+bool wait_until(auto pred)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{10};
+    while (!pred())
+    {
+        if (std::chrono::steady_clock::now() > deadline)
+        {
+            return false;
+        }
+        std::this_thread::yield();
+    }
+    return true;
+}
+
+bool test_adaptive_mutex()
+{
+    bool ok = check_lock_excludes<AdaptiveMutex>();
+
+    // Held for way longer than the spin limit, so the waiter has to go to sleep
+    AdaptiveMutex mutex;
+    std::atomic<bool> acquired{false};
+
+    mutex.lock();
+    std::thread waiter([&mutex, &acquired]()
+        {
+            mutex.lock();
+            acquired.store(true);
+            mutex.unlock();
+        });
+
+    bool parked = wait_until([&mutex]() { return mutex.stats().parked == 1; });
+    std::this_thread::sleep_for(std::chrono::milliseconds{20});
+    ok &= parked && !acquired.load();
+
+    mutex.unlock();
+    ok &= wait_until([&acquired]() { return acquired.load(); });
+    waiter.join();
+
+    return ok;
+}
+
+bool test_ticket_lock()
+{
+    constexpr std::size_t WAITERS = 6;
+
+    bool ok = check_lock_excludes<TicketLock>();
+
+    // Waiters get in line one after another while the lock is held,
+    // and have to get it in that same order
+    TicketLock lock;
+    std::vector<std::size_t> order;
+
+    lock.lock();
+    std::vector<std::thread> waiters;
+    for (std::size_t i = 0; i < WAITERS; ++i)
+    {
+        waiters.emplace_back([&lock, &order, i]()
+            {
+                std::lock_guard guard{lock};
+                order.push_back(i);
+            });
+
+        // Contended is counted right after the ticket is taken
+        ok &= wait_until([&lock, i]() { return lock.stats().contended == i + 1; });
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds{20});
+    lock.unlock();
+
+    for (auto& waiter : waiters)
+    {
+        waiter.join();
+    }
+
+    ok &= order.size() == WAITERS;
+    for (std::size_t i = 0; i < order.size(); ++i)
+    {
+        ok &= order[i] == i;
+    }
+
+    return ok;
+}
+
+bool test_frame_allocator()
+{
+    constexpr std::size_t ROUNDS = 100;
+    constexpr std::size_t FRAMES = 200;
+
+    auto frame_size = [](std::size_t i) { return 64 + i * 97; };
+
+    // Frames allocated on one thread and freed on another, like coroutines hopping pools
+    std::vector<std::byte*> frames;
+    for (std::size_t round = 0; round < ROUNDS; ++round)
+    {
+        for (std::size_t i = 0; i < FRAMES; ++i)
+        {
+            auto frame = static_cast<std::byte*>(FrameAllocator::allocate(frame_size(i)));
+            std::fill_n(frame, frame_size(i), static_cast<std::byte>(i));
+            frames.push_back(frame);
+        }
+
+        bool intact = true;
+        std::thread freeing([&frames, &frame_size, &intact]()
+            {
+                for (std::size_t i = 0; i < frames.size(); ++i)
+                {
+                    intact &= frames[i][frame_size(i) - 1] == static_cast<std::byte>(i);
+                    FrameAllocator::deallocate(frames[i], frame_size(i));
+                }
+            });
+        freeing.join();
+        frames.clear();
+
+        if (!intact)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool test_pooled_task()
+{
+    ThreadPool pool{2};
+    bool ok = true;
+
+    auto doubled = [&pool](int x) -> PooledTask<int>
+        {
+            co_await unifex::schedule(pool.get_scheduler());
+            co_return x * 2;
+        };
+
+    auto sum = [&doubled]() -> PooledTask<int>
+        {
+            int a = co_await unifex::just(20);
+            int b = co_await doubled(a);
+            co_return a + b;
+        };
+    ok &= unifex::sync_wait(sum()) == 60;
+
+    // Errors come out of co_await and out of the task itself
+    auto failing = [&pool]() -> PooledTask<void>
+        {
+            co_await unifex::schedule(pool.get_scheduler());
+            throw std::runtime_error("expected");
+        };
+    auto caught = [&failing]() -> PooledTask<bool>
+        {
+            try
+            {
+                co_await failing();
+            }
+            catch (const std::runtime_error&)
+            {
+                co_return true;
+            }
+            co_return false;
+        };
+    ok &= unifex::sync_wait(caught()) == true;
+
+    bool thrown = false;
+    try
+    {
+        unifex::sync_wait(failing());
+    }
+    catch (const std::runtime_error&)
+    {
+        thrown = true;
+    }
+    ok &= thrown;
+
+    // Done skips the rest of the body, all the way up
+    bool resumed = false;
+    auto cancelled = [&resumed]() -> PooledTask<void>
+        {
+            co_await unifex::just_done();
+            resumed = true;
+        };
+    auto outer = [&cancelled, &resumed]() -> PooledTask<int>
+        {
+            co_await cancelled();
+            resumed = true;
+            co_return 1;
+        };
+    ok &= !unifex::sync_wait(outer()).has_value() && !resumed;
+
+    // Never started tasks just free their frame
+    {
+        auto unused = sum();
+    }
+
+    return ok;
+}
+
+bool test_static_scope()
+{
+    constexpr std::size_t SLOTS = 4;
+    constexpr std::size_t SPAWNERS = 4;
+    constexpr std::size_t OPS_PER_SPAWNER = 5000;
+    constexpr std::size_t OPS = SPAWNERS * OPS_PER_SPAWNER;
+
+    ThreadPool pool{4};
+    StaticScope<SLOTS, PooledTask<void>> scope{SLOTS};
+
+    std::vector<std::atomic<std::uint32_t>> ran(OPS);
+    std::atomic<std::size_t> live{0};
+    std::atomic<std::size_t> max_live{0};
+
+    // Nothing has been spawned yet, so this completes right away
+    unifex::sync_wait(scope.all_finished());
+
+    auto op = [&pool, &ran, &live, &max_live](std::size_t i) -> PooledTask<void>
+        {
+            co_await unifex::schedule(pool.get_scheduler());
+
+            auto now = live.fetch_add(1) + 1;
+            auto max = max_live.load();
+            while (now > max && !max_live.compare_exchange_weak(max, now))
+            {
+            }
+
+            // Stay around for a bit, so that the scope fills up and spawners have to park
+            for (std::size_t k = 0; k < i % 8; ++k)
+            {
+                std::this_thread::yield();
+            }
+
+            ran[i].fetch_add(1);
+            live.fetch_sub(1);
+        };
+
+    std::vector<std::thread> spawners;
+    for (std::size_t t = 0; t < SPAWNERS; ++t)
+    {
+        spawners.emplace_back([&scope, &op, t]()
+            {
+                for (std::size_t i = t * OPS_PER_SPAWNER; i < (t + 1) * OPS_PER_SPAWNER; ++i)
+                {
+                    // Completes once the op owns a slot, which might be one freed by another op
+                    unifex::sync_wait(scope.spawn_next(op(i)));
+                }
+            });
+    }
+
+    for (auto& spawner : spawners)
+    {
+        spawner.join();
+    }
+
+    // The last ops are most likely still running
+    unifex::sync_wait(scope.all_finished());
+
+    bool ok = live.load() == 0 && max_live.load() <= SLOTS;
+    ok &= std::all_of(ran.begin(), ran.end(), [](const auto& count) { return count.load() == 1; });
+
+    // Usable again once empty
+    unifex::sync_wait(scope.spawn_next(op(0)));
+    unifex::sync_wait(scope.all_finished());
+    ok &= ran[0].load() == 2;
+
+    return ok;
+}
+
+bool test_flecs_os_api()
+{
+    install_flecs_os_api();
+    auto before = flecs_memory_stats();
+
+    bool ok = true;
+
+    auto block = static_cast<std::byte*>(ecs_os_malloc(24));
+    std::fill_n(block, 24, std::byte{7});
+
+    // Stays in its size class
+    auto grown = static_cast<std::byte*>(ecs_os_realloc(block, 40));
+    ok &= grown == block;
+
+    auto moved = static_cast<std::byte*>(ecs_os_realloc(grown, 20000));
+    ok &= std::all_of(moved, moved + 24, [](std::byte b) { return b == std::byte{7}; });
+
+    auto zeroed = static_cast<std::byte*>(ecs_os_calloc(300));
+    ok &= std::all_of(zeroed, zeroed + 300, [](std::byte b) { return b == std::byte{0}; });
+
+    auto during = flecs_memory_stats();
+    ok &= during.live_bytes() - before.live_bytes() == 20000 + 300;
+
+    ecs_os_free(moved);
+    ecs_os_free(zeroed);
+    ecs_os_free(nullptr);
+
+    auto delta = flecs_memory_stats();
+    delta -= before;
+    ok &= delta.allocations == 3 && delta.frees == 3 && delta.bytes_allocated == delta.bytes_freed;
+
+    auto mutex = ecs_os_mutex_new();
+    auto cond = ecs_os_cond_new();
+    bool signaled = false;
+    std::thread signaler([mutex, cond, &signaled]()
+        {
+            ecs_os_mutex_lock(mutex);
+            signaled = true;
+            ecs_os_mutex_unlock(mutex);
+            ecs_os_cond_signal(cond);
+        });
+
+    ecs_os_mutex_lock(mutex);
+    while (!signaled)
+    {
+        ecs_os_cond_wait(cond, mutex);
+    }
+    ecs_os_mutex_unlock(mutex);
+    signaler.join();
+
+    ecs_os_cond_free(cond);
+    ecs_os_mutex_free(mutex);
+
+    return ok;
+}
+
+bool test_transform_hierarchy()
+{
+    flecs::world world;
+    register_transform_systems(world);
 
+    auto parent = world.entity().set<CPosition>(CPosition{
+        .position = {1, 0, 0},
+        .rotation = glm::identity<glm::quat>(),
+    });
+    auto child = world.entity().child_of(parent).set<CPosition>(CPosition{
+        .position = {0, 1, 0},
+        .rotation = glm::identity<glm::quat>(),
+    });
+    auto grandchild = world.entity().child_of(child).set<CPosition>(CPosition{
+        .position = {0, 0, 1},
+        .rotation = glm::identity<glm::quat>(),
+    });
+    auto other = world.entity().set<CPosition>(CPosition{
+        .position = {5, 0, 0},
+        .rotation = glm::identity<glm::quat>(),
+    });
+
+    auto translation = [](flecs::entity e) { return glm::vec3(e.get<CWorldTransform>()->matrix[3]); };
+    auto version = [](flecs::entity e) { return e.get<CWorldTransform>()->version; };
+
+    world.progress();
+    bool ok = translation(grandchild) == glm::vec3(1, 1, 1);
+
+    // Nothing moved, nothing gets recomputed
+    auto other_version = version(other);
+    auto grandchild_version = version(grandchild);
+    world.progress();
+    ok &= version(other) == other_version && version(grandchild) == grandchild_version;
+
+    // Moving the root cascades to the whole chain, but not to unrelated entities
+    auto moved = parent.get_mut<CPosition>();
+    moved->position = {2, 0, 0};
+    moved->dirty = true;
+    world.progress();
+    ok &= translation(grandchild) == glm::vec3(2, 1, 1);
+    ok &= version(grandchild) != grandchild_version && version(other) == other_version;
+
+    return ok;
+}
+
+bool test_transform_kernels()
+{
+    auto close = [](const glm::mat4& a, const glm::mat4& b)
+        {
+            for (int c = 0; c < 4; ++c)
+            {
+                for (int r = 0; r < 4; ++r)
+                {
+                    if (std::abs(a[c][r] - b[c][r]) > 1e-4f * (1.f + std::abs(b[c][r])))
+                    {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        };
+
+    auto id = glm::identity<glm::mat4>();
+
+    auto check_isa = [&close, &id]()
+        {
+            bool ok = true;
+
+            // Sizes around the SIMD widths, to hit the padded tails
+            for (std::size_t count : {1, 3, 4, 7, 8, 9, 17})
+            {
+                std::vector<glm::vec3> positions;
+                std::vector<glm::quat> rotations;
+                std::vector<glm::vec3> scales;
+                std::vector<std::uint8_t> uniform;
+                std::vector<glm::mat4> expected;
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    auto f = static_cast<float>(i);
+                    positions.emplace_back(f, -f, 2 * f);
+                    rotations.push_back(glm::angleAxis(0.3f * f, glm::normalize(glm::vec3(1, f, 2))));
+                    // Every other one is stretched
+                    scales.push_back(i % 2 == 0 ? glm::vec3(1 + f) : glm::vec3(1, 2, 3));
+                    uniform.push_back(i % 2 == 0);
+                    expected.push_back(translate(id, positions[i]) * mat4_cast(rotations[i]) * scale(id, scales[i]));
+                }
+
+                std::vector<glm::mat4> matrices(count);
+                compose_trs(positions, rotations, scales, matrices);
+
+                std::vector<glm::mat4> products(count);
+                multiply_matrices(matrices, matrices, products);
+
+                auto parent = translate(id, glm::vec3(1, 2, 3));
+                std::vector<glm::mat4> children(count);
+                multiply_matrices(parent, matrices, children);
+
+                std::vector<glm::mat4> normals(count);
+                normal_matrices(matrices, uniform, normals);
+
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    ok &= close(matrices[i], expected[i]);
+                    ok &= close(products[i], expected[i] * expected[i]);
+                    ok &= close(children[i], parent * expected[i]);
+                    ok &= close(normals[i], glm::mat4(transpose(inverse(glm::mat3(expected[i])))));
+                    ok &= has_uniform_scale(expected[i]) == (uniform[i] != 0);
+                }
+            }
+
+            // Long runs of uniformly scaled matrices, so that whole blocks take the
+            // fast path, followed by a stretched run and a uniform tail
+            {
+                constexpr std::size_t COUNT = 37;
+                std::vector<glm::mat4> models;
+                std::vector<std::uint8_t> uniform;
+                for (std::size_t i = 0; i < COUNT; ++i)
+                {
+                    auto f = static_cast<float>(i);
+                    bool is_uniform = i < 16 || i >= 24;
+                    auto s = is_uniform ? glm::vec3(0.5f + 0.25f * f) : glm::vec3(2, 1, 0.5f);
+                    models.push_back(translate(id, glm::vec3(f, 1, -f))
+                        * mat4_cast(glm::angleAxis(0.2f * f, glm::normalize(glm::vec3(f, 1, 3))))
+                        * scale(id, s));
+                    uniform.push_back(is_uniform);
+                }
+
+                std::vector<glm::mat4> normals(COUNT);
+                normal_matrices(models, uniform, normals);
+
+                for (std::size_t i = 0; i < COUNT; ++i)
+                {
+                    ok &= close(normals[i], glm::mat4(transpose(inverse(glm::mat3(models[i])))));
+                }
+            }
+
+            return ok;
+        };
+
+    bool ok = true;
+    std::size_t checked = 0;
+    for (auto isa : {"scalar", "sse2", "avx2"})
+    {
+        // Whatever this build and CPU don't have is skipped
+        if (!force_transform_kernels_isa(isa))
+        {
+            continue;
+        }
+        ok &= std::string_view{transform_kernels_isa()} == isa;
+        ok &= check_isa();
+        ++checked;
+    }
+    force_transform_kernels_isa(nullptr);
+
+    return ok && checked > 0;
+}
+
+bool test_frame_arena()
+{
+    constexpr std::size_t ROUNDS = 50;
+    constexpr int VALUES = 100000;
+
+    FrameArena arena;
+    bool ok = true;
+    for (std::size_t round = 0; round < ROUNDS; ++round)
+    {
+        auto lease = arena.try_lease();
+        ok &= static_cast<bool>(lease) && !arena.try_lease();
+
+        std::pmr::vector<int> values{lease.resource()};
+        for (int i = 0; i < VALUES; ++i)
+        {
+            values.push_back(i);
+        }
+
+        // Other threads get their own chunks
+        std::thread other([&lease, &ok]()
+            {
+                std::pmr::vector<double> doubles{lease.resource()};
+                doubles.resize(1000, 1.0);
+                auto aligned = lease.resource()->allocate(100, 64);
+                ok &= reinterpret_cast<std::uintptr_t>(aligned) % 64 == 0;
+            });
+        other.join();
+
+        for (int i = 0; i < VALUES; ++i)
+        {
+            ok &= values[i] == i;
+        }
+    }
+
+    return ok;
+}
+
+bool test_concurrent_hash_map()
+{
+    constexpr std::size_t WRITERS = 4;
+    constexpr std::size_t PER_WRITER = 20000;
+
+    ConcurrentHashMap<std::size_t, std::size_t> map;
+
+    std::atomic<bool> writing{true};
+    bool reader_ok = true;
+    std::thread reader([&map, &writing, &reader_ok]()
+        {
+            while (writing.load())
+            {
+                for (std::size_t key = 0; key < 1000; ++key)
+                {
+                    if (auto value = map.find(key))
+                    {
+                        reader_ok &= *value == 3 * key;
+                    }
+                }
+            }
+        });
+
+    std::vector<std::thread> writers;
+    std::vector<char> writer_ok(WRITERS, true);
+    for (std::size_t w = 0; w < WRITERS; ++w)
+    {
+        writers.emplace_back([&map, &writer_ok, w]()
+            {
+                for (std::size_t i = 0; i < PER_WRITER; ++i)
+                {
+                    auto key = i * WRITERS + w;
+                    auto [value, inserted] = map.try_emplace(key, 3 * key);
+                    writer_ok[w] &= inserted && *value == 3 * key;
+                    writer_ok[w] &= !map.try_emplace(key, 0).second;
+                }
+            });
+    }
+
+    for (auto& writer : writers)
+    {
+        writer.join();
+    }
+    writing.store(false);
+    reader.join();
+
+    bool ok = reader_ok && std::all_of(writer_ok.begin(), writer_ok.end(), [](char c) { return c != 0; });
+    ok &= map.size() == WRITERS * PER_WRITER;
+    for (std::size_t key = 0; key < WRITERS * PER_WRITER; ++key)
+    {
+        auto value = map.find(key);
+        ok &= value != nullptr && *value == 3 * key;
+    }
+    ok &= !map.contains(WRITERS * PER_WRITER);
+
+    return ok;
+}
+
+bool test_task_graph()
+{
+    constexpr std::size_t RUNS = 100;
+
+    ThreadPool pool{4};
+    bool ok = true;
+
+    {
+        // Diamond: a -> (b, c) -> d, plus an unrelated pinned node
+        std::atomic<std::size_t> a{0};
+        std::atomic<std::size_t> b{0};
+        std::atomic<std::size_t> c{0};
+        std::atomic<std::size_t> d{0};
+        std::atomic<std::size_t> pinned{0};
+        std::atomic<bool> order_ok{true};
+
+        TaskGraph graph{pool.get_scheduler()};
+        auto node_a = graph.add("a", [&a]() { a.fetch_add(1); });
+        auto node_b = graph.add("b", [&a, &b, &order_ok]()
+            {
+                order_ok = order_ok && a.load() > b.load();
+                b.fetch_add(1);
+            });
+        auto node_c = graph.add_async("c", [&a, &c, &order_ok]() -> PooledTask<void>
+            {
+                order_ok = order_ok && a.load() > c.load();
+                c.fetch_add(1);
+                co_return;
+            });
+        auto node_d = graph.add("d", [&b, &c, &d, &order_ok]()
+            {
+                order_ok = order_ok && b.load() > d.load() && c.load() > d.load();
+                d.fetch_add(1);
+            });
+        graph.add_pinned("pinned", 1, [&pinned]() { pinned.fetch_add(1); });
+        graph.depends_on(node_b, node_a);
+        graph.depends_on(node_c, node_a);
+        graph.depends_on(node_d, node_b);
+        graph.depends_on(node_d, node_c);
+
+        for (std::size_t i = 0; i < RUNS; ++i)
+        {
+            unifex::sync_wait(graph.run());
+        }
+
+        ok &= order_ok.load() && d.load() == RUNS && pinned.load() == RUNS;
+    }
+
+    {
+        // Nodes after a failed one are skipped, the error reaches the awaiter
+        bool after_ran = false;
+        TaskGraph graph{pool.get_scheduler()};
+        auto failing = graph.add("failing", []() { throw std::runtime_error("expected"); });
+        auto after = graph.add("after", [&after_ran]() { after_ran = true; });
+        graph.depends_on(after, failing);
+
+        bool thrown = false;
+        try
+        {
+            unifex::sync_wait(graph.run());
+        }
+        catch (const std::runtime_error&)
+        {
+            thrown = true;
+        }
+
+        ok &= thrown && !after_ran;
+    }
+
+    pool.request_stop();
+    return ok;
+}
+
+bool test_parallel_for()
+{
+    constexpr std::size_t COUNT = 10007;
+    constexpr std::size_t GRAIN = 16;
+
+    ThreadPool pool{4};
+    auto scheduler = pool.get_scheduler();
+    bool ok = true;
+
+    {
+        bool called = false;
+        unifex::sync_wait(parallel_for(scheduler, 0, [&called](std::size_t) { called = true; }));
+        ok &= !called;
+    }
+
+    {
+        std::vector<std::atomic<std::uint32_t>> seen(COUNT);
+        unifex::sync_wait(parallel_for(scheduler, COUNT, [&seen](std::size_t i) { seen[i].fetch_add(1); }, GRAIN));
+        ok &= std::all_of(seen.begin(), seen.end(), [](const auto& count) { return count.load() == 1; });
+    }
+
+    {
+        std::vector<std::atomic<std::uint32_t>> seen(COUNT);
+        std::atomic<bool> chunks_ok{true};
+        unifex::sync_wait(parallel_for(scheduler, COUNT,
+            [&seen, &chunks_ok](std::size_t begin, std::size_t end)
+            {
+                // Only the last chunk may be smaller than the grain
+                if (begin >= end || (end - begin < GRAIN && end != COUNT))
+                {
+                    chunks_ok = false;
+                }
+                for (auto i = begin; i < end; ++i)
+                {
+                    seen[i].fetch_add(1);
+                }
+            }, GRAIN));
+        ok &= chunks_ok.load();
+        ok &= std::all_of(seen.begin(), seen.end(), [](const auto& count) { return count.load() == 1; });
+    }
+
+    {
+        // A grain larger than the whole range makes it a single chunk
+        std::vector<std::pair<std::size_t, std::size_t>> chunks;
+        unifex::sync_wait(parallel_for(scheduler, 10,
+            [&chunks](std::size_t begin, std::size_t end) { chunks.emplace_back(begin, end); }, 100));
+        ok &= chunks == std::vector<std::pair<std::size_t, std::size_t>>{{0, 10}};
+    }
+
+    {
+        bool thrown = false;
+        try
+        {
+            unifex::sync_wait(parallel_for(scheduler, COUNT, [](std::size_t i)
+                {
+                    if (i == COUNT / 2)
+                    {
+                        throw std::runtime_error("expected");
+                    }
+                }));
+        }
+        catch (const std::runtime_error&)
+        {
+            thrown = true;
+        }
+        ok &= thrown;
+    }
+
+    {
+        // With a single worker the chunks are claimed in order, so nothing after the throw may run
+        ThreadPool single{1};
+        std::size_t processed = 0;
+        bool thrown = false;
+        try
+        {
+            unifex::sync_wait(parallel_for(single.get_scheduler(), COUNT, [&processed](std::size_t i)
+                {
+                    if (i == 5)
+                    {
+                        throw std::runtime_error("expected");
+                    }
+                    ++processed;
+                }));
+        }
+        catch (const std::runtime_error&)
+        {
+            thrown = true;
+        }
+        ok &= thrown && processed == 5;
+        single.request_stop();
+    }
+
+    pool.request_stop();
+    return ok;
+}
+
+struct FlagReceiver
+{
+    bool* flag;
+
+    void set_value() noexcept { *flag = true; }
+    void set_error(std::exception_ptr) noexcept {}
+    void set_done() noexcept {}
+};
+
+bool test_async_rw_lock()
+{
+    AsyncRwLock lock;
+    bool reader1 = false;
+    bool reader2 = false;
+    bool writer = false;
+    bool reader3 = false;
+    bool reader4 = false;
+
+    auto op1 = lock.async_lock_shared().connect(FlagReceiver{&reader1});
+    auto op2 = lock.async_lock_shared().connect(FlagReceiver{&reader2});
+    auto op3 = lock.async_lock().connect(FlagReceiver{&writer});
+    auto op4 = lock.async_lock_shared().connect(FlagReceiver{&reader3});
+    auto op5 = lock.async_lock_shared().connect(FlagReceiver{&reader4});
+    op1.start();
+    op2.start();
+    op3.start();
+    op4.start();
+    op5.start();
+
+    // Readers share, the waiting writer keeps later readers out
+    bool ok = reader1 && reader2 && !writer && !reader3 && !lock.try_lock_shared();
+
+    lock.unlock_shared();
+    ok &= !writer;
+    lock.unlock_shared();
+    ok &= writer && !reader3;
+
+    // Both readers queued behind the writer get in together
+    lock.unlock();
+    ok &= reader3 && reader4 && !lock.try_lock();
+
+    lock.unlock_shared();
+    lock.unlock_shared();
+    ok &= lock.try_lock();
+    lock.unlock();
+
+    return ok;
+}
+
+struct WaiterReceiver
+{
+    std::vector<std::size_t>* woken;
+    std::vector<std::size_t>* cancelled;
+    std::size_t id;
+    unifex::inplace_stop_token stop_token{};
+
+    void set_value() noexcept { woken->push_back(id); }
+    void set_error(std::exception_ptr) noexcept {}
+    void set_done() noexcept { cancelled->push_back(id); }
+
+    friend unifex::inplace_stop_token tag_invoke(unifex::tag_t<unifex::get_stop_token>,
+        const WaiterReceiver& r) noexcept
+    {
+        return r.stop_token;
+    }
+};
+
+bool test_async_semaphore()
+{
+    bool ok = true;
+
+    AsyncSemaphore semaphore{1};
+    std::vector<std::size_t> woken;
+    std::vector<std::size_t> cancelled;
+    unifex::inplace_stop_source stop;
+
+    auto waiter = [&](std::size_t id, unifex::inplace_stop_token token = {})
+        {
+            return unifex::connect(semaphore.acquire(), WaiterReceiver{&woken, &cancelled, id, token});
+        };
+
+    ok &= semaphore.try_acquire();
+
+    auto op0 = waiter(0);
+    auto op1 = waiter(1, stop.get_token());
+    auto op2 = waiter(2);
+    auto op3 = waiter(3);
+    unifex::start(op0);
+    unifex::start(op1);
+    unifex::start(op2);
+    unifex::start(op3);
+    ok &= woken.empty();
+
+    // The permit goes straight to the first waiter, try_acquire can't overtake the rest
+    semaphore.release();
+    ok &= woken == std::vector<std::size_t>{0} && !semaphore.try_acquire();
+
+    // A stopped waiter leaves the queue without a permit
+    stop.request_stop();
+    ok &= cancelled == std::vector<std::size_t>{1};
+
+    // release(n) wakes n waiters in order, the permit nobody waited for is kept
+    semaphore.release(3);
+    ok &= woken == std::vector<std::size_t>{0, 2, 3};
+    ok &= semaphore.try_acquire() && !semaphore.try_acquire();
+
+    // Nor does one that is stopped before it even starts waiting
+    semaphore.release();
+    auto op4 = waiter(4, stop.get_token());
+    unifex::start(op4);
+    ok &= cancelled == std::vector<std::size_t>{1, 4} && semaphore.try_acquire();
+
+    return ok;
+}
+
+struct TimerResult
+{
+    // 0 while pending, then 1 for value, 2 for done and 3 for error
+    std::atomic<int> state{0};
+    TimerWheel::Clock::time_point fired_at;
+};
+
+struct TimerReceiver
+{
+    TimerResult* result;
+    unifex::inplace_stop_token stop_token{};
+
+    void set_value() noexcept
+    {
+        result->fired_at = TimerWheel::Clock::now();
+        result->state.store(1);
+    }
+    void set_error(std::exception_ptr) noexcept { result->state.store(3); }
+    void set_done() noexcept { result->state.store(2); }
+
+    friend unifex::inplace_stop_token tag_invoke(unifex::tag_t<unifex::get_stop_token>,
+        const TimerReceiver& r) noexcept
+    {
+        return r.stop_token;
+    }
+};
+
+int wait_for_timer(const TimerResult& result)
+{
+    auto until = TimerWheel::Clock::now() + std::chrono::seconds{5};
+    while (result.state.load() == 0 && TimerWheel::Clock::now() < until)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    }
+    return result.state.load();
+}
+
+bool test_timer_wheel()
+{
+    using namespace std::chrono_literals;
+    using Clock = TimerWheel::Clock;
+
+    ThreadPool pool{2};
+    bool ok = true;
+
+    {
+        // Just below a level 4 boundary: the later timers land on level 4 and
+        // cascade down once it is crossed, the last one through level 1
+        TimerWheel wheel{pool.get_scheduler(), (std::uint64_t{1} << 4 * TimerWheel::SLOT_BITS) - 20};
+        auto scheduler = wheel.get_scheduler();
+
+        std::array delays{10ms, 40ms, 250ms};
+        std::array<TimerResult, 3> results;
+        auto start = Clock::now();
+        auto op0 = unifex::connect(scheduler.schedule_after(delays[2]), TimerReceiver{&results[2]});
+        auto op1 = unifex::connect(scheduler.schedule_after(delays[0]), TimerReceiver{&results[0]});
+        auto op2 = unifex::connect(scheduler.schedule_after(delays[1]), TimerReceiver{&results[1]});
+        unifex::start(op0);
+        unifex::start(op1);
+        unifex::start(op2);
+
+        for (std::size_t i = 0; i < results.size(); ++i)
+        {
+            ok &= wait_for_timer(results[i]) == 1 && results[i].fired_at >= start + delays[i];
+        }
+        ok &= results[0].fired_at <= results[1].fired_at && results[1].fired_at <= results[2].fired_at;
+
+        wheel.request_stop();
+    }
+
+    {
+        // The later timer is past the end of the wheel and waits in the overflow list
+        TimerWheel wheel{pool.get_scheduler(), TimerWheel::WHEEL_SPAN - 20};
+        auto scheduler = wheel.get_scheduler();
+
+        TimerResult near;
+        TimerResult far;
+        auto start = Clock::now();
+        auto far_op = unifex::connect(scheduler.schedule_after(60ms), TimerReceiver{&far});
+        auto near_op = unifex::connect(scheduler.schedule_after(5ms), TimerReceiver{&near});
+        unifex::start(far_op);
+        unifex::start(near_op);
+
+        ok &= wait_for_timer(near) == 1 && wait_for_timer(far) == 1;
+        ok &= far.fired_at >= start + 60ms && near.fired_at < far.fired_at;
+
+        wheel.request_stop();
+    }
+
+    {
+        TimerWheel wheel{pool.get_scheduler()};
+        auto scheduler = wheel.get_scheduler();
+
+        unifex::inplace_stop_source stopped_later;
+        unifex::inplace_stop_source never_stopped;
+        unifex::inplace_stop_source stopped_before;
+        stopped_before.request_stop();
+
+        TimerResult cancelled;
+        TimerResult fired;
+        TimerResult never_started;
+        TimerResult on_shutdown;
+        auto cancelled_op = unifex::connect(scheduler.schedule_after(10s),
+            TimerReceiver{&cancelled, stopped_later.get_token()});
+        auto fired_op = unifex::connect(scheduler.schedule_after(2ms),
+            TimerReceiver{&fired, never_stopped.get_token()});
+        auto never_started_op = unifex::connect(scheduler.schedule_after(10s),
+            TimerReceiver{&never_started, stopped_before.get_token()});
+        auto on_shutdown_op = unifex::connect(scheduler.schedule_after(10s), TimerReceiver{&on_shutdown});
+        unifex::start(cancelled_op);
+        unifex::start(fired_op);
+        unifex::start(never_started_op);
+        unifex::start(on_shutdown_op);
+
+        // Cancelled timers complete right away instead of at their deadline
+        auto start = Clock::now();
+        stopped_later.request_stop();
+        ok &= wait_for_timer(cancelled) == 2 && Clock::now() - start < 1s;
+        ok &= wait_for_timer(fired) == 1 && never_started.state.load() == 2;
+
+        // Whatever is still pending gets cancelled when the wheel stops
+        ok &= on_shutdown.state.load() == 0;
+        wheel.request_stop();
+        ok &= wait_for_timer(on_shutdown) == 2;
+    }
+
+    pool.request_stop();
+    return ok;
+}
+
+}
 
 
 int main()
 {
+    bool ok = true;
+    ok &= test_lockfree_queue();
+    ok &= test_work_stealing_deque();
+    ok &= test_atomic_uint_tuple();
+    ok &= test_latency_histogram();
+    ok &= test_adaptive_mutex();
+    ok &= test_ticket_lock();
+    ok &= test_frame_allocator();
+    ok &= test_pooled_task();
+    ok &= test_static_scope();
+    ok &= test_async_rw_lock();
+    ok &= test_async_semaphore();
+    ok &= test_timer_wheel();
+    ok &= test_frame_arena();
+    ok &= test_concurrent_hash_map();
+    ok &= test_task_graph();
+    ok &= test_parallel_for();
+    ok &= test_flecs_os_api();
+    ok &= test_transform_hierarchy();
+    ok &= test_transform_kernels();
 
-    return 0;
+    std::cout << (ok ? "OK" : "FAILED") << std::endl;
+    return ok ? 0 : 1;
 }